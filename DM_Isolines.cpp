@@ -1,5 +1,4 @@
 #include "DM_Isolines.h"
-#include "IsolineMaker.h"
 
 #include <DM/DM_RenderTable.h>
 #include <GUI/GUI_ViewState.h>
@@ -17,14 +16,42 @@ const char *VertexShader =
     "uniform mat4 glH_ProjectMatrix; \n"
     "uniform mat4 glH_ViewMatrix; \n"
     "in vec3 P; \n"
-    "in vec3 Cd; \n"
-    "out vec4 clr; \n"
+    "in vec3 N; \n"
+    "in float crease; \n"
+    "out float vsCrease; \n"
+    "out float vsFacing; \n"
     "void main() \n"
     "{ \n"
-    "  clr = vec4(Cd, 1.0); \n"
+    "  vsCrease = crease; \n"
+    "  vsFacing = (glH_ViewMatrix * vec4(N, 0.0)).z; \n"
     "  gl_Position = glH_ProjectMatrix * glH_ViewMatrix * vec4(P, 1.0); \n"
     "} \n";
 
+// drops segments whose first sample faces away from the camera and colors
+// the rest by the crease of their edge, shared corner samples carry -1 so
+// the inner sample of the segment wins
+const char *GeometryShader =
+    "#version 150 \n"
+    "layout(lines) in; \n"
+    "layout(line_strip, max_vertices = 2) out; \n"
+    "in float vsCrease[]; \n"
+    "in float vsFacing[]; \n"
+    "out vec4 clr; \n"
+    "void main() \n"
+    "{ \n"
+    "  if (vsFacing[0] < 0.0) \n"
+    "    return; \n"
+    "  float crease = clamp(max(vsCrease[0], vsCrease[1]) / 4.0, 0.0, 1.0); \n"
+    "  vec4 color = vec4(mix(vec3(0.0, 0.9, 0.9), vec3(1.0, 0.0, 0.0), \n"
+    "                        crease), 1.0); \n"
+    "  for (int i = 0; i < 2; ++i) { \n"
+    "    clr = color; \n"
+    "    gl_Position = gl_in[i].gl_Position; \n"
+    "    EmitVertex(); \n"
+    "  } \n"
+    "  EndPrimitive(); \n"
+    "} \n";
+
 const char *FragmentShader = "#version 150 \n"
                              "in vec4 clr; \n"
                              "out vec4 color; \n"
@@ -35,48 +62,54 @@ const char *FragmentShader = "#version 150 \n"
 
 #define VIEWPORT_LOD_PARM 5
 
-void DM_IsolinesDisplay::updateNodeState(const DM_GeoDetail &CurrentGeoDetail,
-                                         GU_DetailHandle &DetailHandle,
-                                         UT_DMatrix4 &LocalToWorld,
-                                         bool &IsValidState,
-                                         bool &ShouldRecalculate) {
-  ShouldRecalculate = false;
-  OP_Node *ObjNodeRef = CurrentGeoDetail.getObject();
-  IsValidState = !!ObjNodeRef;
+// chunks switch to coarser samples while a segment stays below this size
+const float LodPixelSize = 4.0f;
 
-  if (!IsValidState)
-    return;
+DM_IsolinesDisplay::ObjectState *
+DM_IsolinesDisplay::updateNodeState(const DM_GeoDetail &GeoDetail) {
+  OP_Node *ObjNodeRef = GeoDetail.getObject();
+
+  if (!ObjNodeRef)
+    return NULL;
 
   OBJ_Node *ObjNode = CAST_OBJNODE(ObjNodeRef);
-  SOP_Node *SopNode = ObjNode->getDisplaySopPtr();
+  SOP_Node *SopNode = ObjNode ? ObjNode->getDisplaySopPtr() : NULL;
+
+  if (!SopNode)
+    return NULL;
 
   int CurrentSopUid = SopNode->getUniqueId();
   OP_VERSION CurrentCookVersion = SopNode->getVersionParms();
   int CurrentSubdivDisplayState = ObjNode->evalInt("viewportlod", 0, 0);
 
-  ShouldRecalculate = CurrentSopUid != SopUid ||
-                      CurrentCookVersion != CookVersion ||
-                      CurrentSubdivDisplayState != SubdivDisplayState;
+  if (CurrentSubdivDisplayState != VIEWPORT_LOD_PARM)
+    return NULL;
 
-  SopUid = CurrentSopUid;
-  CookVersion = CurrentCookVersion;
-  SubdivDisplayState = CurrentSubdivDisplayState;
+  UT_UniquePtr<ObjectState> &Object = Objects[CurrentSopUid];
+  if (!Object)
+    Object.reset(new ObjectState);
+  // an object listed twice in a pass is only drawn once
+  if (Object->LastPass == Pass)
+    return NULL;
+  Object->LastPass = Pass;
 
-  IsValidState = CurrentSubdivDisplayState == VIEWPORT_LOD_PARM;
+  // acquiring every pass keeps the entry recent in the shared cache
+  Object->Entry = DM_IsolinesCache::instance().acquire(CurrentSopUid);
 
   OP_Context Context(CHgetEvalTime());
-  UT_DMatrix4 TransformMatrix;
+  UT_DMatrix4 LocalToWorld;
   ObjNode->getLocalToWorldTransform(Context, LocalToWorld);
 
-  DetailHandle = ObjNode->getDisplayGeometryHandle(Context);
-}
+  GU_DetailHandle DetailHandle = ObjNode->getDisplayGeometryHandle(Context);
 
-const float PeakValue = 0.0;
-const int SubdivisionLevel = 3;
+  // frames already computed are served by time during playback
+  Object->Entry->update(CurrentCookVersion, CurrentSubdivDisplayState,
+                        Context.getTime(), DetailHandle, LocalToWorld);
+  return Object.get();
+}
 
-bool DM_IsolinesDisplay::isGeoDetailValid(
-    const DM_GeoDetail &CurrentGeoDetail) {
-  return CurrentGeoDetail.isValid() && CurrentGeoDetail.getNumDetails() > 0;
+bool DM_IsolinesDisplay::isGeoDetailValid(const DM_GeoDetail &GeoDetail) {
+  return GeoDetail.isValid() && GeoDetail.getNumDetails() > 0;
 }
 
 bool DM_IsolinesDisplay::render(RE_Render *Render,
@@ -84,84 +117,116 @@ bool DM_IsolinesDisplay::render(RE_Render *Render,
   if (!HookData.disp_options->isSceneOptionEnabled("isolines_display"))
     return false;
 
-  DM_GeoDetail CurrentGeoDetail = viewport().getCurrentDetail();
-
-  if (!isGeoDetailValid(CurrentGeoDetail))
-    return false;
+  Pass++;
+  for (int x = 0; x < viewport().getNumOpaqueObjects(); ++x)
+    renderObject(Render, viewport().getOpaqueObject(x));
+  for (int x = 0; x < viewport().getNumTransparentObjects(); ++x)
+    renderObject(Render, viewport().getTransparentObject(x));
+
+  // hidden objects only keep their isolines in the shared cache
+  for (auto It = Objects.begin(); It != Objects.end();) {
+    if (It->second->LastPass != Pass)
+      It = Objects.erase(It);
+    else
+      ++It;
+  }
+  DM_IsolinesCache::instance().trim();
 
-  bool IsValidState, ShouldRecalculate;
-  GU_DetailHandle CurrentDetailHandle;
-  UT_DMatrix4 LocalToWorldMatrix;
+  return false;
+}
 
-  updateNodeState(CurrentGeoDetail, CurrentDetailHandle, LocalToWorldMatrix,
-                  IsValidState, ShouldRecalculate);
+void DM_IsolinesDisplay::renderObject(RE_Render *Render,
+                                      const DM_GeoDetail &GeoDetail) {
+  if (!isGeoDetailValid(GeoDetail))
+    return;
 
-  if (!IsValidState)
-    return false;
+  ObjectState *Object = updateNodeState(GeoDetail);
+  if (!Object)
+    return;
 
-  updateDrawableArrays();
-  drawArrays(Render);
+  // keep drawing the previous result until the background job is done
+  if (Object->Entry->isComputing())
+    viewport().requestDraw();
 
-  if (!ShouldRecalculate)
-    return false;
+  updateGeometry(Render, *Object);
+  updateVisibleChunks(Render, *Object);
+  drawArrays(Render, *Object);
+}
 
-  IsolineMaker IsoMaker(CurrentDetailHandle, LocalToWorldMatrix, PeakValue,
-                        SubdivisionLevel);
+void DM_IsolinesDisplay::updateGeometry(RE_Render *Render,
+                                        ObjectState &Object) {
+  // published results are immutable, so the handle doubles as the version
+  // of the uploaded buffers
+  DM_IsolinesResultHandle Result = Object.Entry->result();
 
-  if (!IsoMaker.calculateAttributeArrays())
-    return false;
+  if (Result == Object.UploadedResult)
+    return;
 
-  IsoMaker.getAttributeArrays(Positions, Colors, Normals);
-  CachedViewTransform = UT_DMatrix4(1);
+  Object.UploadedResult = Result;
 
-  return false;
-}
+  // a new result always reconnects its strips
+  Object.ChunkLevels.clear();
 
-void DM_IsolinesDisplay::updateDrawableArrays() {
+  if (!Result || Result->Positions.entries() == 0) {
+    Object.Geometry.reset();
+    return;
+  }
 
-  const GUI_ViewState *ViewState = &viewport().getViewStateRef();
-  const UT_Matrix4D ViewTransform = ViewState->getRotateMatrix();
+  if (!Object.Geometry)
+    Object.Geometry.reset(new RE_Geometry);
+
+  // facing is tested in the geometry shader, so tumbling the camera never
+  // touches these buffers
+  RE_Geometry &Geometry = *Object.Geometry;
+  Geometry.setNumPoints(Result->Positions.entries());
+  Geometry.createAttribute(Render, "P", RE_GPU_FLOAT32, 3,
+                           Result->Positions.array());
+  Geometry.createAttribute(Render, "N", RE_GPU_FLOAT32, 3,
+                           Result->Normals.array());
+  Geometry.createAttribute(Render, "crease", RE_GPU_FLOAT32, 1,
+                           Result->Creases.array());
+}
 
-  if (ViewTransform.isEqual(CachedViewTransform))
+void DM_IsolinesDisplay::updateVisibleChunks(RE_Render *Render,
+                                             ObjectState &Object) {
+  if (!Object.Geometry)
     return;
 
-  DrawableColors.clear();
-  DrawablePositions.clear();
-
-  UT_Matrix4D ViewTransformInverted = ViewTransform;
-  ViewTransformInverted.invertDouble();
-  UT_Vector3 viewDirection = UT_Vector3(0.0, 0.0, 1.0) * ViewTransformInverted;
-
-  for (int x = 0; x < (Normals.entries() / 2); ++x) {
-    int Index = x * 2;
-    if (viewDirection.dot(Normals[Index]) < 0.0)
-      continue;
-    DrawableColors.append(Colors[Index]);
-    DrawableColors.append(Colors[Index + 1]);
-    DrawablePositions.append(Positions[Index]);
-    DrawablePositions.append(Positions[Index + 1]);
-  }
-  CachedViewTransform = ViewTransform;
-}
+  // houdini matrices take row vectors, world to clip is view then
+  // projection
+  const GUI_ViewState &ViewState = viewport().getViewStateRef();
+  const UT_Matrix4D &Projection = ViewState.getProjectionMatrix();
+  const UT_Matrix4D WorldToClip = ViewState.getTransformMatrix() * Projection;
 
-void DM_IsolinesDisplay::drawArrays(RE_Render *Render) {
-  int ItemCount = DrawableColors.entries();
+  const IsolineChunks &Chunks = Object.UploadedResult->Chunks;
+  UT_Array<int> Levels;
+  Chunks.selectLevels(WorldToClip, Projection(1, 1), ViewState.getViewHeight(),
+                      LodPixelSize, Levels);
 
-  if (ItemCount == 0)
+  // only a changed selection uploads indices, the samples stay put
+  if (Levels == Object.ChunkLevels)
     return;
 
-  RE_Geometry RenderGeo(ItemCount);
+  Object.ChunkLevels = Levels;
+  Chunks.gatherIndices(Object.ChunkLevels, Object.VisibleIndices);
 
-  RE_VertexArray *PosRenderAttr = RenderGeo.createAttribute(
-      Render, "P", RE_GPU_FLOAT32, 3, DrawablePositions.array());
-  RE_VertexArray *ColRenderAttr = RenderGeo.createAttribute(
-      Render, "Cd", RE_GPU_FLOAT32, 3, DrawableColors.array());
+  // the restart index -1 reads as ~0u once the indices are unsigned
+  Object.Geometry->connectIndexedPrims(
+      Render, 0, RE_PRIM_LINE_STRIP, Object.VisibleIndices.entries(),
+      reinterpret_cast<const unsigned *>(Object.VisibleIndices.array()),
+      NULL, true);
+}
 
-  RenderGeo.connectAllPrims(Render, 0, RE_PRIM_LINES, NULL, true);
+void DM_IsolinesDisplay::drawArrays(RE_Render *Render,
+                                    ObjectState &Object) {
+  if (!Object.Geometry || Object.VisibleIndices.isEmpty())
+    return;
 
   if (!Shader) {
     Shader = RE_Shader::create("lines");
     Shader->addShader(Render, RE_SHADER_VERTEX, VertexShader, "vertex", 0);
+    Shader->addShader(Render, RE_SHADER_GEOMETRY, GeometryShader, "geometry",
+                      0);
     Shader->addShader(Render, RE_SHADER_FRAGMENT, FragmentShader, "fragment",
                       0);
     Shader->linkShaders(Render);
@@ -173,7 +238,10 @@ void DM_IsolinesDisplay::drawArrays(RE_Render *Render) {
   Render->pushPointSize(3.0);
   Render->pushSmoothLines();
   Render->pushLineWidth(3.0);
-  RenderGeo.draw(Render, 0);
+  Render->enablePrimitiveRestart(true);
+  Render->setPrimitiveRestartIndex(~0u);
+  Object.Geometry->draw(Render, 0);
+  Render->enablePrimitiveRestart(false);
   Render->popLineWidth();
   Render->popSmoothLines();
   Render->popPointSize();
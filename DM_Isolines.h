@@ -1,7 +1,12 @@
 #pragma once
 
+#include "DM_IsolinesCache.h"
+
 #include <DM/DM_SceneHook.h>
 #include <DM/DM_VPortAgent.h>
+#include <RE/RE_Geometry.h>
+#include <UT/UT_Map.h>
+#include <UT/UT_UniquePtr.h>
 
 class DM_IsolinesDisplay : public DM_SceneRenderHook {
 public:
@@ -12,27 +17,37 @@ public:
   virtual bool render(RE_Render *r, const DM_SceneHookData &HookData);
 
 private:
-  void updateDrawableArrays();
-  void drawArrays(RE_Render *Render);
-  void updateNodeState(const DM_GeoDetail &CurrentGeoDetail,
-                       GU_DetailHandle &DetailHandle, UT_DMatrix4 &LocalToWorld,
-                       bool &IsValidState, bool &ShouldRecalculate);
-  bool isGeoDetailValid(const DM_GeoDetail &CurrentGeoDetail);
-
-  RE_Shader *Shader = NULL;
+  // isolines of one displayed object in this viewport
+  struct ObjectState {
+    // isolines shared with the other viewports
+    DM_IsolinesEntryHandle Entry;
+    // gpu buffers kept across frames and the result they were filled from
+    UT_UniquePtr<RE_Geometry> Geometry;
+    DM_IsolinesResultHandle UploadedResult;
+    // per chunk level of the connected indices, -1 for culled chunks
+    UT_Array<int> ChunkLevels;
+    UT_Array<int> VisibleIndices;
+    // render pass the object was last displayed in
+    exint LastPass = 0;
+  };
 
-  UT_Vector3FArray Positions;
-  UT_Vector3FArray Colors;
-  UT_Vector3FArray Normals;
+  // draws the isolines of an object if its lod is subdivision
+  void renderObject(RE_Render *Render, const DM_GeoDetail &GeoDetail);
+  // re-uploads the buffers only when the shared result was replaced
+  void updateGeometry(RE_Render *Render, ObjectState &Object);
+  // culls chunks against the frustum and picks their sample level, indices
+  // are only reconnected when the selection changed
+  void updateVisibleChunks(RE_Render *Render, ObjectState &Object);
+  void drawArrays(RE_Render *Render, ObjectState &Object);
+  ObjectState *updateNodeState(const DM_GeoDetail &GeoDetail);
+  bool isGeoDetailValid(const DM_GeoDetail &GeoDetail);
 
-  UT_Vector3FArray DrawablePositions;
-  UT_Vector3FArray DrawableColors;
-
-  UT_DMatrix4 CachedViewTransform;
+  RE_Shader *Shader = NULL;
 
-  int SopUid = -999;
-  int SubdivDisplayState = -1;
-  OP_VERSION CookVersion = -999;
+  // objects displayed in the last pass keyed by SOP unique id, the ones
+  // that went away release their buffers and their hold on the entry
+  UT_Map<int, UT_UniquePtr<ObjectState>> Objects;
+  exint Pass = 0;
 };
 
 class DM_IsolinesDisplayHook : public DM_SceneHook {
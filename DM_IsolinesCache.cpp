@@ -0,0 +1,349 @@
+#include "DM_IsolinesCache.h"
+
+#include <UT/UT_StopWatch.h>
+
+#include <stdlib.h>
+
+const float PeakValue = 0.0;
+const int SubdivisionLevel = 3;
+// scrubbing a deforming mesh only multiplies the limit stencils
+const bool UseStencils = true;
+const double DefaultProgressiveDelayMs = 30.0;
+const int64 DefaultMemoryCapMb = 1024;
+
+namespace {
+const char *getCacheDirectory() {
+  const char *Directory = getenv("CB_ISOLINES_CACHE_DIR");
+  return Directory ? Directory : "";
+}
+
+double getProgressiveDelay() {
+  const char *DelayMs = getenv("CB_ISOLINES_PROGRESSIVE_MS");
+  return DelayMs ? atof(DelayMs) : DefaultProgressiveDelayMs;
+}
+} // namespace
+
+// cache files written by batch cooks of the isolines SOP, see
+// IsolineMaker::setCacheDirectory
+const UT_StringHolder CacheDirectory(getCacheDirectory());
+// a new topology shows its cage and the lower levels once the job runs
+// longer than this, CB_ISOLINES_PROGRESSIVE_MS milliseconds or
+// DefaultProgressiveDelayMs, faster jobs publish the final level only
+const double ProgressiveDelayMs = getProgressiveDelay();
+// use stamps of the playback frames of all entries, so the cache trims
+// them least recently shown first across objects
+SYS_AtomicInt64 FrameClock;
+
+DM_IsolinesEntry::~DM_IsolinesEntry() {
+  {
+    UT_Lock::Scope Scope(Lock);
+    if (HasPendingRequest)
+      PendingRequest.DetailHandle.removePreserveRequest();
+    HasPendingRequest = false;
+    Cancelled.store(1);
+  }
+  if (Worker.joinable())
+    Worker.join();
+}
+
+void DM_IsolinesEntry::update(OP_VERSION CookVersion, int LodState,
+                              fpreal Time, const GU_DetailHandle &DetailHandle,
+                              const UT_DMatrix4 &LocalToWorld) {
+  if (CookVersion == this->CookVersion && LodState == this->LodState)
+    return;
+
+  this->CookVersion = CookVersion;
+  this->LodState = LodState;
+
+  // the next cook builds a new detail instead of modifying this one while
+  // the job still reads it
+  GU_DetailHandle PreservedHandle = DetailHandle;
+  PreservedHandle.addPreserveRequest();
+
+  UT_Lock::Scope Scope(Lock);
+  if (HasPendingRequest)
+    PendingRequest.DetailHandle.removePreserveRequest();
+  PendingRequest.DetailHandle = PreservedHandle;
+  PendingRequest.LocalToWorld = LocalToWorld;
+  PendingRequest.Time = Time;
+  HasPendingRequest = true;
+  DisplayTime = Time;
+  // a job for another frame still finishes into the playback cache, the
+  // newest request waits for it
+  if (RunningTime == Time)
+    Cancelled.store(1);
+
+  if (!IsWorkerRunning) {
+    // a finished worker has already left the lock for good
+    if (Worker.joinable())
+      Worker.join();
+    IsWorkerRunning = true;
+    Worker = std::thread(&DM_IsolinesEntry::run, this);
+  }
+}
+
+DM_IsolinesResultHandle DM_IsolinesEntry::result() {
+  UT_Lock::Scope Scope(Lock);
+  // the cage of a new topology only shows once its job overruns the delay,
+  // a light mesh goes straight to its final level
+  if (CageResult && !Cancelled.load() && RunningTime == DisplayTime &&
+      CageWatch.lap() * 1000.0 >= ProgressiveDelayMs) {
+    Result = CageResult;
+    CageResult.reset();
+  }
+  return Result;
+}
+
+bool DM_IsolinesEntry::isComputing() {
+  UT_Lock::Scope Scope(Lock);
+  return IsWorkerRunning;
+}
+
+int64 DM_IsolinesEntry::memoryUsage() {
+  UT_Lock::Scope Scope(Lock);
+  // the result on screen is usually one of the playback frames
+  auto It = Frames.find(ResultTime);
+  const bool IsFrame = It != Frames.end() && It->second.Result == Result;
+  return MakerMemoryUsage + FramesMemoryUsage +
+         (Result && !IsFrame ? Result->getMemoryUsage() : 0);
+}
+
+exint DM_IsolinesEntry::oldestFrameUse() {
+  UT_Lock::Scope Scope(Lock);
+  auto Oldest = findOldestFrame();
+  return Oldest != Frames.end() ? Oldest->second.LastUse : -1;
+}
+
+int64 DM_IsolinesEntry::evictOldestFrame() {
+  UT_Lock::Scope Scope(Lock);
+  auto Oldest = findOldestFrame();
+  if (Oldest == Frames.end())
+    return 0;
+  const int64 Usage = Oldest->second.Result->getMemoryUsage();
+  FramesMemoryUsage -= Usage;
+  Frames.erase(Oldest);
+  return Usage;
+}
+
+UT_Map<fpreal, DM_IsolinesEntry::Frame>::iterator
+DM_IsolinesEntry::findOldestFrame() {
+  // the frames of the display time and on screen stay
+  auto Oldest = Frames.end();
+  for (auto It = Frames.begin(); It != Frames.end(); ++It) {
+    if (It->first == DisplayTime || It->first == ResultTime)
+      continue;
+    if (Oldest == Frames.end() || It->second.LastUse < Oldest->second.LastUse)
+      Oldest = It;
+  }
+  return Oldest;
+}
+
+bool DM_IsolinesEntry::serveFrame(const Request &Job) {
+  // the frame is only reused when it still holds the same content, an edit
+  // upstream changes every frame, the maker only hashes what changed ids
+  if (!IsoMaker.hashContent())
+    return false;
+
+  DM_IsolinesResultHandle FrameResult;
+  {
+    UT_Lock::Scope Scope(Lock);
+    auto It = Frames.find(Job.Time);
+    if (It == Frames.end() || It->second.LocalToWorld != Job.LocalToWorld ||
+        It->second.TopologyHash != IsoMaker.getTopologyHash() ||
+        It->second.PositionHash != IsoMaker.getPositionHash())
+      return false;
+    It->second.LastUse = FrameClock.add(1);
+    FrameResult = It->second.Result;
+  }
+  publish(Job, FrameResult);
+  return true;
+}
+
+void DM_IsolinesEntry::storeFrame(const Request &Job,
+                                  const DM_IsolinesResultHandle &FrameResult) {
+  // the hashes calculateAttributeArrays keyed the result on
+  const uint64 TopologyHash = IsoMaker.getTopologyHash();
+  const uint64 PositionHash = IsoMaker.getPositionHash();
+
+  UT_Lock::Scope Scope(Lock);
+  if (Cancelled.load())
+    return;
+
+  Frame &NewFrame = Frames[Job.Time];
+  if (NewFrame.Result)
+    FramesMemoryUsage -= NewFrame.Result->getMemoryUsage();
+  NewFrame.Result = FrameResult;
+  NewFrame.LocalToWorld = Job.LocalToWorld;
+  NewFrame.TopologyHash = TopologyHash;
+  NewFrame.PositionHash = PositionHash;
+  NewFrame.LastUse = FrameClock.add(1);
+  FramesMemoryUsage += FrameResult->getMemoryUsage();
+}
+
+void DM_IsolinesEntry::run() {
+  for (;;) {
+    Request Job;
+    {
+      UT_Lock::Scope Scope(Lock);
+      if (!HasPendingRequest) {
+        IsWorkerRunning = false;
+        return;
+      }
+      Job = PendingRequest;
+      PendingRequest = Request();
+      HasPendingRequest = false;
+      RunningTime = Job.Time;
+      Cancelled.store(0);
+      CageWatch.start();
+    }
+
+    IsoMaker.setDetail(Job.DetailHandle);
+    IsoMaker.setTransform(Job.LocalToWorld);
+    IsoMaker.setPeak(PeakValue);
+    IsoMaker.setUseStencils(UseStencils);
+    IsoMaker.setCacheDirectory(CacheDirectory);
+    IsoMaker.setCancelFlag(&Cancelled);
+
+    // a frame of the same time and content from an earlier pass is shown
+    // without a recompute
+    if (!serveFrame(Job))
+      compute(Job);
+
+    IsoMaker.setDetail(GU_ConstDetailHandle());
+    Job.DetailHandle.removePreserveRequest();
+
+    const int64 Usage = IsoMaker.getMemoryUsage();
+    UT_Lock::Scope Scope(Lock);
+    MakerMemoryUsage = Usage;
+    RunningTime = -SYS_FP64_MAX;
+    CageResult.reset();
+  }
+}
+
+void DM_IsolinesEntry::compute(const Request &Job) {
+  UT_StopWatch Watch;
+  Watch.start();
+
+  // a new topology refines level by level, showing its cage and the
+  // levels once it outlasts the delay, each level only evaluates the
+  // midpoints the previous one lacks, a cache file of the final level
+  // goes there directly
+  IsoMaker.setSubdivisionLevel(SubdivisionLevel);
+  UT_SharedPtr<DM_IsolinesResult> NewCage(new DM_IsolinesResult);
+  UT_Array<int> Indices;
+  const bool IsProgressive =
+      !IsoMaker.hasCacheFile() &&
+      IsoMaker.getCageArrays(NewCage->Positions, NewCage->Normals,
+                             NewCage->Creases, Indices);
+  if (IsProgressive) {
+    NewCage->Chunks.build(NewCage->Positions, Indices);
+    // result() swaps it in if the first level takes too long
+    UT_Lock::Scope Scope(Lock);
+    CageResult = NewCage;
+  }
+
+  DM_IsolinesResultHandle FrameResult;
+  for (int Level = IsProgressive ? 1 : SubdivisionLevel;
+       Level <= SubdivisionLevel; ++Level) {
+    IsoMaker.setSubdivisionLevel(Level);
+    if (!IsoMaker.calculateAttributeArrays()) {
+      // unusable geometry clears the overlay, a cancelled job doesn't
+      // publish anyway
+      publish(Job, DM_IsolinesResultHandle());
+      break;
+    }
+    if (Level < SubdivisionLevel && Watch.lap() * 1000.0 < ProgressiveDelayMs)
+      continue;
+
+    // a recook to identical geometry keeps the last result
+    if (IsoMaker.getArraysVersion() != LastResultVersion) {
+      UT_SharedPtr<DM_IsolinesResult> NewResult(new DM_IsolinesResult);
+      IsoMaker.getAttributeArrays(NewResult->Positions, NewResult->Normals,
+                                  NewResult->Creases, Indices);
+      NewResult->Chunks.build(NewResult->Positions, Indices);
+      LastResult = NewResult;
+      LastResultVersion = IsoMaker.getArraysVersion();
+    }
+    publish(Job, LastResult);
+    if (Level == SubdivisionLevel)
+      FrameResult = LastResult;
+  }
+
+  if (FrameResult)
+    storeFrame(Job, FrameResult);
+}
+
+void DM_IsolinesEntry::publish(const Request &Job,
+                               const DM_IsolinesResultHandle &NewResult) {
+  // results of a job overtaken by a newer cook are thrown away, a frame
+  // the playhead already left still shows until the display time has its
+  // own, so a first pass of playback keeps moving
+  UT_Lock::Scope Scope(Lock);
+  if (Cancelled.load())
+    return;
+  if (Job.Time == DisplayTime || (NewResult && ResultTime != DisplayTime)) {
+    Result = NewResult;
+    ResultTime = Job.Time;
+  }
+  // any level of the job replaces the cage
+  CageResult.reset();
+}
+
+DM_IsolinesCache::DM_IsolinesCache() {
+  const char *CapMb = getenv("CB_ISOLINES_CACHE_MB");
+  MemoryCap = (CapMb ? atoi(CapMb) : DefaultMemoryCapMb) * int64(1024 * 1024);
+}
+
+DM_IsolinesCache &DM_IsolinesCache::instance() {
+  static DM_IsolinesCache Cache;
+  return Cache;
+}
+
+DM_IsolinesEntryHandle DM_IsolinesCache::acquire(int SopUid) {
+  Slot &EntrySlot = Entries[SopUid];
+  if (!EntrySlot.Entry)
+    EntrySlot.Entry.reset(new DM_IsolinesEntry);
+  EntrySlot.LastUse = ++UseClock;
+  return EntrySlot.Entry;
+}
+
+void DM_IsolinesCache::trim() {
+  int64 Usage = 0;
+  for (auto &Item : Entries)
+    Usage += Item.second.Entry->memoryUsage();
+
+  while (Usage > MemoryCap) {
+    // entries a viewport still holds are on screen and never evicted, a
+    // running job is left to finish, destroying its entry would wait for
+    // the job on the draw thread
+    auto Oldest = Entries.end();
+    for (auto It = Entries.begin(); It != Entries.end(); ++It) {
+      if (It->second.Entry.use_count() > 1 || It->second.Entry->isComputing())
+        continue;
+      if (Oldest == Entries.end() ||
+          It->second.LastUse < Oldest->second.LastUse)
+        Oldest = It;
+    }
+    if (Oldest == Entries.end())
+      break;
+
+    Usage -= Oldest->second.Entry->memoryUsage();
+    Entries.erase(Oldest);
+  }
+
+  // then playback frames across all entries, least recently shown first
+  while (Usage > MemoryCap) {
+    DM_IsolinesEntry *Oldest = NULL;
+    exint OldestUse = -1;
+    for (auto &Item : Entries) {
+      const exint Use = Item.second.Entry->oldestFrameUse();
+      if (Use >= 0 && (!Oldest || Use < OldestUse)) {
+        Oldest = Item.second.Entry.get();
+        OldestUse = Use;
+      }
+    }
+    if (!Oldest)
+      break;
+    Usage -= Oldest->evictOldestFrame();
+  }
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "IsolineChunks.h"
+#include "IsolineMaker.h"
+
+#include <GU/GU_DetailHandle.h>
+#include <OP/OP_Node.h>
+#include <SYS/SYS_AtomicInt.h>
+#include <SYS/SYS_Types.h>
+#include <UT/UT_Lock.h>
+#include <UT/UT_Map.h>
+#include <UT/UT_SharedPtr.h>
+#include <UT/UT_StopWatch.h>
+
+#include <thread>
+
+// Finished isoline arrays, never modified once published. Samples are
+// drawn as indexed line strips with a restart index between edges, the
+// chunks hand out the strips of the visible part of the mesh.
+struct DM_IsolinesResult {
+  UT_Vector3FArray Positions;
+  UT_Vector3FArray Normals;
+  UT_Array<float> Creases;
+  IsolineChunks Chunks;
+
+  int64 getMemoryUsage() const {
+    return Positions.getMemoryUsage() + Normals.getMemoryUsage() +
+           Creases.getMemoryUsage() + Chunks.getMemoryUsage();
+  }
+};
+
+typedef UT_SharedPtr<const DM_IsolinesResult> DM_IsolinesResultHandle;
+
+// Isolines of one SOP, shared by every viewport that displays it.
+// Recomputes run on a background thread while viewports keep drawing the
+// last finished result, a slow job publishes coarser results on its way.
+// Final results are also kept per frame time, so looping playback shows
+// frames it has seen before without a recompute.
+class DM_IsolinesEntry {
+public:
+  ~DM_IsolinesEntry();
+
+  // schedules a recompute when the cook version or the lod state differ
+  // from the last request, a job still running for an older cook of the
+  // same time is cancelled. A job finding a finished frame of the same time
+  // and content shows it instead of computing.
+  void update(OP_VERSION CookVersion, int LodState, fpreal Time,
+              const GU_DetailHandle &DetailHandle,
+              const UT_DMatrix4 &LocalToWorld);
+
+  // last finished result, NULL if there is none or the geometry is
+  // unusable
+  DM_IsolinesResultHandle result();
+  // true while a job is queued or running
+  bool isComputing();
+  // bytes of the last result, the playback frames and the maker state of
+  // the last job
+  int64 memoryUsage();
+  // use stamp of the least recently shown playback frame that isn't on
+  // screen, -1 if there is none
+  exint oldestFrameUse();
+  // drops that frame, returns its bytes
+  int64 evictOldestFrame();
+
+private:
+  struct Request {
+    GU_DetailHandle DetailHandle;
+    UT_DMatrix4 LocalToWorld;
+    fpreal Time = 0.0;
+  };
+
+  // final result of a frame and the content it was computed from
+  struct Frame {
+    DM_IsolinesResultHandle Result;
+    UT_DMatrix4 LocalToWorld;
+    uint64 TopologyHash = 0;
+    uint64 PositionHash = 0;
+    exint LastUse = 0;
+  };
+
+  // worker thread body, runs pending requests until there are none left
+  void run();
+  // calculates the isolines of a job level by level and publishes them
+  void compute(const Request &Job);
+  // swaps in a result unless the job was cancelled meanwhile or the
+  // display already shows a result of its own time
+  void publish(const Request &Job, const DM_IsolinesResultHandle &NewResult);
+  // shows the playback cache frame of the job time if its content matches
+  // the job detail, hashed by the maker on the worker
+  bool serveFrame(const Request &Job);
+  // keeps the final result of a job for playback, the cache trims frames
+  // within its memory cap
+  void storeFrame(const Request &Job,
+                  const DM_IsolinesResultHandle &FrameResult);
+  // least recently shown frame off screen, called with the lock held
+  UT_Map<fpreal, Frame>::iterator findOldestFrame();
+
+  // only touched by the worker thread
+  IsolineMaker IsoMaker;
+  DM_IsolinesResultHandle LastResult;
+  exint LastResultVersion = -1;
+
+  UT_Lock Lock;
+  std::thread Worker;
+  bool IsWorkerRunning = false;
+  Request PendingRequest;
+  bool HasPendingRequest = false;
+  SYS_AtomicInt32 Cancelled;
+  DM_IsolinesResultHandle Result;
+  fpreal ResultTime = -SYS_FP64_MAX;
+  // cage of the running job, shown once the job outlasts the progressive
+  // delay
+  DM_IsolinesResultHandle CageResult;
+  UT_StopWatch CageWatch;
+  int64 MakerMemoryUsage = 0;
+  // frame time shown by the viewports and the one the worker computes
+  fpreal DisplayTime = 0.0;
+  fpreal RunningTime = -SYS_FP64_MAX;
+  // finished frames by time for playback
+  UT_Map<fpreal, Frame> Frames;
+  int64 FramesMemoryUsage = 0;
+
+  OP_VERSION CookVersion = -999;
+  int LodState = -1;
+};
+
+typedef UT_SharedPtr<DM_IsolinesEntry> DM_IsolinesEntryHandle;
+
+// Process-wide table of isoline entries keyed by SOP unique id, an entry
+// only recomputes when its SOP cooks again. Entries no viewport holds stay
+// around for when their object shows up again and are evicted least
+// recently used first once the cache exceeds its memory cap, which is
+// CB_ISOLINES_CACHE_MB megabytes or DefaultMemoryCapMb. Playback frames of
+// all entries count towards the same cap and go next.
+class DM_IsolinesCache {
+public:
+  static DM_IsolinesCache &instance();
+
+  // entry of the SOP, marked as the most recently used one
+  DM_IsolinesEntryHandle acquire(int SopUid);
+  // evicts unheld entries without a running job, then playback frames,
+  // until the cache fits its memory cap
+  void trim();
+
+private:
+  DM_IsolinesCache();
+
+  struct Slot {
+    DM_IsolinesEntryHandle Entry;
+    exint LastUse = 0;
+  };
+
+  UT_Map<int, Slot> Entries;
+  exint UseClock = 0;
+  int64 MemoryCap = 0;
+};
@@ -0,0 +1,364 @@
+// Standalone timing of the IsolineMaker stages on synthetic meshes or
+// .bgeo files. Prints one CSV row per mesh, level, thread count and stage
+// with the fastest of the repeats, so runs can be diffed for regressions.
+//
+//   isolines_benchmark [-faces 4096,65536,1048576] [-levels 1,2,3]
+//                      [-threads 1,8] [-repeat 3] [-output results.csv]
+//                      [file.bgeo ...]
+
+#include "IsolineLimitEvaluator.h"
+#include "IsolineMaker.h"
+
+#include <GA/GA_Handle.h>
+#include <GEO/GEO_PolyCounts.h>
+#include <GEO/GEO_PrimPoly.h>
+#include <GU/GU_Detail.h>
+#include <SYS/SYS_Math.h>
+#include <UT/UT_Array.h>
+#include <UT/UT_StopWatch.h>
+#include <UT/UT_StringHolder.h>
+#include <UT/UT_Thread.h>
+
+#include <functional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// faces of one pole disc, its pole has PoleValence edges
+const int PoleValence = 64;
+// every CreaseSpacing-th grid line of a creased cage is creased
+const int CreaseSpacing = 8;
+
+namespace {
+// polygon mesh as point positions and per face point lists
+struct MeshData {
+  UT_Vector3FArray Points;
+  GEO_PolyCounts FaceSizes;
+  UT_Array<int> FacePoints;
+  // crease weight of the half-edge starting at each face vertex
+  UT_Array<float> Creases;
+};
+
+void buildDetail(const MeshData &Mesh, GU_Detail &Gdp) {
+  Gdp.clearAndDestroy();
+  const GA_Offset StartOffset = Gdp.appendPointBlock(Mesh.Points.entries());
+  for (exint x = 0; x < Mesh.Points.entries(); ++x)
+    Gdp.setPos3(StartOffset + x, Mesh.Points[x]);
+  const GA_Offset StartPrim =
+      GEO_PrimPoly::buildBlock(&Gdp, StartOffset, Mesh.Points.entries(),
+                               Mesh.FaceSizes, Mesh.FacePoints.getArray());
+
+  if (Mesh.Creases.isEmpty())
+    return;
+
+  // vertices are appended in face order along with the primitives
+  GA_RWHandleF CreaseHandle(
+      Gdp.addFloatTuple(GA_ATTRIB_VERTEX, "creaseweight", 1));
+  exint Corner = 0;
+  for (GA_Index Face = 0; Face < Gdp.getNumPrimitives(); ++Face) {
+    const GA_OffsetListRef Vertices =
+        Gdp.getPrimitiveVertexList(StartPrim + Face);
+    for (GA_Size x = 0; x < Vertices.entries(); ++x)
+      CreaseHandle.set(Vertices.get(x), Mesh.Creases[Corner++]);
+  }
+}
+
+void addGridPoints(MeshData &Mesh, int Width, int Height) {
+  for (int y = 0; y <= Height; ++y)
+    for (int x = 0; x <= Width; ++x)
+      Mesh.Points.append(
+          UT_Vector3F(x, 0.1f * SYSsin(x * 0.5f + y * 0.3f), y));
+}
+
+void addFace(MeshData &Mesh, const int *Points, int Count) {
+  Mesh.FaceSizes.append(Count);
+  for (int x = 0; x < Count; ++x)
+    Mesh.FacePoints.append(Points[x]);
+}
+
+// square grid of quads, creased along every CreaseSpacing-th line
+void makeGrid(int FaceCount, bool HasCreases, MeshData &Mesh) {
+  const int Side = SYSmax(1, int(SYSsqrt(float(FaceCount))));
+  addGridPoints(Mesh, Side, Side);
+  for (int y = 0; y < Side; ++y) {
+    for (int x = 0; x < Side; ++x) {
+      const int First = y * (Side + 1) + x;
+      const int Quad[4] = {First, First + 1, First + Side + 2,
+                           First + Side + 1};
+      addFace(Mesh, Quad, 4);
+      if (!HasCreases)
+        continue;
+
+      // half-edges along rows y and y + 1 and columns x + 1 and x, the
+      // weight follows the line so both faces of a crease agree on it
+      auto weight = [](int Line) {
+        return Line % CreaseSpacing == 0
+                   ? 1.0f + (Line / CreaseSpacing) % 4
+                   : 0.0f;
+      };
+      Mesh.Creases.append(weight(y));
+      Mesh.Creases.append(weight(x + 1));
+      Mesh.Creases.append(weight(y + 1));
+      Mesh.Creases.append(weight(x));
+    }
+  }
+}
+
+// grid rows of hexagons over two cells, triangle pairs and quads
+void makeMixed(int FaceCount, MeshData &Mesh) {
+  const int Side = SYSmax(4, int(SYSsqrt(float(FaceCount))) & ~3);
+  addGridPoints(Mesh, Side, Side);
+  for (int y = 0; y < Side; ++y) {
+    const int Row = y * (Side + 1);
+    const int NextRow = Row + Side + 1;
+    for (int x = 0; x < Side; x += 4) {
+      const int Hexagon[6] = {Row + x,         Row + x + 1,
+                              Row + x + 2,     NextRow + x + 2,
+                              NextRow + x + 1, NextRow + x};
+      addFace(Mesh, Hexagon, 6);
+      const int Triangles[2][3] = {{Row + x + 2, Row + x + 3, NextRow + x + 3},
+                                   {Row + x + 2, NextRow + x + 3,
+                                    NextRow + x + 2}};
+      addFace(Mesh, Triangles[0], 3);
+      addFace(Mesh, Triangles[1], 3);
+      const int Quad[4] = {Row + x + 3, Row + x + 4, NextRow + x + 4,
+                           NextRow + x + 3};
+      addFace(Mesh, Quad, 4);
+    }
+  }
+}
+
+// row of discs, each a pole of PoleValence triangles in quad rings
+void makePoles(int FaceCount, MeshData &Mesh) {
+  const int Rings = PoleValence;
+  const int DiscCount = SYSmax(1, FaceCount / (PoleValence * Rings));
+  for (int Disc = 0; Disc < DiscCount; ++Disc) {
+    const int Center = Mesh.Points.entries();
+    const float OffsetX = Disc * (2.0f * Rings + 1.0f);
+    Mesh.Points.append(UT_Vector3F(OffsetX, 1.0f, 0.0f));
+    for (int Ring = 1; Ring <= Rings; ++Ring) {
+      for (int x = 0; x < PoleValence; ++x) {
+        const float Angle = 2.0f * M_PI * x / PoleValence;
+        Mesh.Points.append(UT_Vector3F(OffsetX + Ring * SYScos(Angle),
+                                       1.0f / (1.0f + Ring),
+                                       Ring * SYSsin(Angle)));
+      }
+    }
+
+    auto ringPoint = [&](int Ring, int x) {
+      return Center + 1 + (Ring - 1) * PoleValence + x % PoleValence;
+    };
+    for (int x = 0; x < PoleValence; ++x) {
+      const int Triangle[3] = {Center, ringPoint(1, x + 1), ringPoint(1, x)};
+      addFace(Mesh, Triangle, 3);
+    }
+    for (int Ring = 1; Ring < Rings; ++Ring) {
+      for (int x = 0; x < PoleValence; ++x) {
+        const int Quad[4] = {ringPoint(Ring, x), ringPoint(Ring, x + 1),
+                             ringPoint(Ring + 1, x + 1),
+                             ringPoint(Ring + 1, x)};
+        addFace(Mesh, Quad, 4);
+      }
+    }
+  }
+}
+
+bool parseList(const char *Text, UT_Array<int> &Values) {
+  Values.clear();
+  for (const char *Item = Text; *Item;) {
+    char *End;
+    const long Value = strtol(Item, &End, 10);
+    if (End == Item || Value <= 0)
+      return false;
+    Values.append(int(Value));
+    Item = *End == ',' ? End + 1 : End;
+  }
+  return !Values.isEmpty();
+}
+} // namespace
+
+// Runs the maker stages in the order calculateAttributeArrays does, each
+// one timed on its own
+class IsolineBenchmark {
+public:
+  IsolineBenchmark(FILE *Output, int Repeats)
+      : Output(Output), Repeats(Repeats) {}
+
+  void run(const char *MeshName, GU_Detail &Gdp, const UT_Array<int> &Levels,
+           const UT_Array<int> &Threads) {
+    GU_DetailHandle GdpHandle;
+    GdpHandle.allocateAndSet(&Gdp, false);
+
+    for (int ThreadCount : Threads) {
+      UT_Thread::configureMaxThreads(ThreadCount);
+      for (int Level : Levels) {
+        Row = {MeshName, Gdp.getNumPrimitives(), Level, ThreadCount};
+        runStages(GdpHandle, Level);
+      }
+    }
+  }
+
+private:
+  struct RowKey {
+    const char *MeshName;
+    GA_Size FaceCount;
+    int Level;
+    int ThreadCount;
+  };
+
+  void runStages(const GU_DetailHandle &GdpHandle, int Level) {
+    IsolineMaker Maker;
+    Maker.setDetail(GdpHandle);
+    Maker.setSubdivisionLevel(Level);
+    Maker.setPeak(0.005f);
+
+    bool IsValid = false;
+    time("isValidGeo", [&]() { IsValid = Maker.isValidGeo(); });
+    if (!IsValid) {
+      fprintf(stderr, "%s: unsupported geometry\n", Row.MeshName);
+      return;
+    }
+
+    time("updateTopology", [&]() {
+      Maker.updateTopology();
+      Maker.Evaluator->setupTopology(Maker.Topology, Maker.HasCrease);
+    });
+    time("fillAttributeArrays", [&]() { Maker.fillAttributeArrays(); });
+    time("setupSamples", [&]() {
+      Maker.Evaluator->setupSamples(Maker.FaceIndices, Maker.U, Maker.V);
+    });
+    Maker.PositionId = Maker.getPositionId();
+    time("getLimitSurfacePositions",
+         [&]() { Maker.getLimitSurfacePositions(); });
+    Maker.BboxScale = Maker.getBboxScale();
+    time("applyLimitSurfacePositions",
+         [&]() { Maker.applyLimitSurfacePositions(); });
+
+    GU_Detail TargetGdp;
+    time("createGeometry", [&]() {
+      TargetGdp.clearAndDestroy();
+      Maker.createGeometry(&TargetGdp);
+    });
+    Maker.setChainEdges(true);
+    time("createChainedGeometry", [&]() {
+      TargetGdp.clearAndDestroy();
+      Maker.createGeometry(&TargetGdp);
+    });
+
+    // the whole pipeline on a fresh maker, including the data id checks
+    time("calculateAttributeArrays", [&]() {
+      IsolineMaker FreshMaker;
+      FreshMaker.setDetail(GdpHandle);
+      FreshMaker.setSubdivisionLevel(Level);
+      FreshMaker.calculateAttributeArrays();
+    });
+    Maker.setDetail(GU_ConstDetailHandle());
+  }
+
+  void time(const char *Stage, const std::function<void()> &Body) {
+    double Best = SYS_FP64_MAX;
+    for (int x = 0; x < Repeats; ++x) {
+      UT_StopWatch Watch;
+      Watch.start();
+      Body();
+      Best = SYSmin(Best, double(Watch.lap()));
+    }
+    fprintf(Output, "%s,%lld,%d,%d,%s,%.6f\n", Row.MeshName,
+            (long long)Row.FaceCount, Row.Level, Row.ThreadCount, Stage, Best);
+    fflush(Output);
+  }
+
+  FILE *Output;
+  int Repeats;
+  RowKey Row = {"", 0, 0, 0};
+};
+
+int main(int argc, char *argv[]) {
+  UT_Array<int> FaceCounts, Levels, Threads;
+  parseList("4096,65536,1048576", FaceCounts);
+  parseList("1,2,3", Levels);
+  Threads.append(1);
+  if (UT_Thread::getNumProcessors() > 1)
+    Threads.append(UT_Thread::getNumProcessors());
+  int Repeats = 3;
+  const char *OutputPath = NULL;
+  UT_Array<const char *> Files;
+
+  for (int x = 1; x < argc; ++x) {
+    const bool HasValue = x + 1 < argc;
+    bool IsValid = true;
+    if (!strcmp(argv[x], "-faces") && HasValue)
+      IsValid = parseList(argv[++x], FaceCounts);
+    else if (!strcmp(argv[x], "-levels") && HasValue)
+      IsValid = parseList(argv[++x], Levels);
+    else if (!strcmp(argv[x], "-threads") && HasValue)
+      IsValid = parseList(argv[++x], Threads);
+    else if (!strcmp(argv[x], "-repeat") && HasValue)
+      IsValid = (Repeats = atoi(argv[++x])) > 0;
+    else if (!strcmp(argv[x], "-output") && HasValue)
+      OutputPath = argv[++x];
+    else if (argv[x][0] != '-')
+      Files.append(argv[x]);
+    else
+      IsValid = false;
+
+    if (!IsValid) {
+      fprintf(stderr,
+              "usage: %s [-faces n,...] [-levels n,...] [-threads n,...] "
+              "[-repeat n] [-output file.csv] [file.bgeo ...]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  FILE *Output = OutputPath ? fopen(OutputPath, "w") : stdout;
+  if (!Output) {
+    fprintf(stderr, "cannot write %s\n", OutputPath);
+    return 1;
+  }
+  fprintf(Output, "mesh,faces,level,threads,stage,seconds\n");
+
+  IsolineBenchmark Benchmark(Output, Repeats);
+  GU_Detail Gdp;
+
+  // files replace the synthetic meshes
+  for (const char *File : Files) {
+    Gdp.clearAndDestroy();
+    if (!Gdp.load(File).success()) {
+      fprintf(stderr, "cannot load %s\n", File);
+      continue;
+    }
+    Benchmark.run(File, Gdp, Levels, Threads);
+  }
+
+  for (int x = 0; Files.isEmpty() && x < FaceCounts.entries(); ++x) {
+    const int FaceCount = FaceCounts[x];
+    const char *Names[4] = {"grid", "mixed", "poles", "creased"};
+    for (int Kind = 0; Kind < 4; ++Kind) {
+      MeshData Mesh;
+      if (Kind == 0 || Kind == 3)
+        makeGrid(FaceCount, Kind == 3, Mesh);
+      else if (Kind == 1)
+        makeMixed(FaceCount, Mesh);
+      else
+        makePoles(FaceCount, Mesh);
+      buildDetail(Mesh, Gdp);
+
+      // creases that don't survive the topology build would time the grid
+      // case again
+      if (Kind == 3) {
+        IsolineTopology Topology;
+        Topology.build(&Gdp);
+        if (!Topology.hasCrease()) {
+          fprintf(stderr, "%s: topology has no creases\n", Names[Kind]);
+          continue;
+        }
+      }
+      Benchmark.run(Names[Kind], Gdp, Levels, Threads);
+    }
+  }
+
+  if (Output != stdout)
+    fclose(Output);
+  return 0;
+}
@@ -0,0 +1,247 @@
+#include "IsolineChunks.h"
+
+#include <UT/UT_ParallelUtil.h>
+#include <UT/UT_Vector4.h>
+
+#include <utility>
+
+// strips per chunk, small enough to cull tightly and large enough to keep
+// the per frame traversal cheap
+const int StripsPerChunk = 256;
+const int MortonBits = 10;
+
+namespace {
+// spreads the low 10 bits of a value to every third bit
+uint32 spreadBits(uint32 Value) {
+  Value &= 0x3ff;
+  Value = (Value | (Value << 16)) & 0x30000ff;
+  Value = (Value | (Value << 8)) & 0x300f00f;
+  Value = (Value | (Value << 4)) & 0x30c30c3;
+  Value = (Value | (Value << 2)) & 0x9249249;
+  return Value;
+}
+} // namespace
+
+void IsolineChunks::build(const UT_Vector3FArray &Positions,
+                          const UT_Array<int> &Indices) {
+  Nodes.clear();
+  ChunkBoxes.clear();
+  ChunkSegmentLengths.clear();
+  LevelIndices.clear();
+  LevelOffsets.clear();
+
+  // strip ranges, restart index excluded
+  UT_Array<exint> StripStarts, StripEnds;
+  for (exint x = 0, Start = 0; x < Indices.entries(); ++x) {
+    if (Indices[x] >= 0)
+      continue;
+    StripStarts.append(Start);
+    StripEnds.append(x);
+    Start = x + 1;
+  }
+
+  const exint StripCount = StripStarts.entries();
+  if (StripCount == 0)
+    return;
+
+  // sort strips along a morton curve through their middle sample
+  UT_BoundingBox Bounds;
+  Bounds.initBounds();
+  for (exint x = 0; x < Positions.entries(); ++x)
+    Bounds.enlargeBounds(Positions[x]);
+  const UT_Vector3 Size = Bounds.size();
+
+  UT_Array<std::pair<uint32, exint>> Order;
+  Order.setSizeNoInit(StripCount);
+  UTparallelFor(
+      UT_BlockedRange<exint>(0, StripCount),
+      [&](const UT_BlockedRange<exint> &Range) {
+        for (exint x = Range.begin(); x != Range.end(); ++x) {
+          const UT_Vector3 &Middle =
+              Positions[Indices[(StripStarts[x] + StripEnds[x]) / 2]];
+          uint32 Code = 0;
+          for (int Axis = 0; Axis < 3; ++Axis) {
+            float Factor =
+                Size[Axis] > 0.0f
+                    ? (Middle[Axis] - Bounds.minvec()[Axis]) / Size[Axis]
+                    : 0.0f;
+            uint32 Cell = SYSclamp(int(Factor * (1 << MortonBits)), 0,
+                                   (1 << MortonBits) - 1);
+            Code |= spreadBits(Cell) << Axis;
+          }
+          Order[x] = std::make_pair(Code, x);
+        }
+      });
+  UTparallelSort(Order.begin(), Order.end());
+
+  // level k keeps every 2^k-th inner sample, the coarsest level still keeps
+  // one inner sample per strip
+  int MaxInner = 0;
+  for (exint x = 0; x < StripCount; ++x)
+    MaxInner = SYSmax(MaxInner, int(StripEnds[x] - StripStarts[x] - 2));
+  int LevelCount = 1;
+  while ((2 << LevelCount) - 1 <= MaxInner)
+    LevelCount++;
+  LevelIndices.setSize(LevelCount);
+  LevelOffsets.setSize(LevelCount);
+
+  const int ChunkCount = (StripCount + StripsPerChunk - 1) / StripsPerChunk;
+  ChunkBoxes.setSize(ChunkCount);
+  ChunkSegmentLengths.setSize(ChunkCount);
+  for (int Level = 0; Level < LevelCount; ++Level)
+    LevelOffsets[Level].setSize(ChunkCount + 1);
+
+  for (int Chunk = 0; Chunk < ChunkCount; ++Chunk) {
+    const exint First = Chunk * StripsPerChunk;
+    const exint Last = SYSmin(First + StripsPerChunk, StripCount);
+    UT_BoundingBox &Box = ChunkBoxes[Chunk];
+    Box.initBounds();
+    float Length = 0.0f;
+    exint SegmentCount = 0;
+
+    for (int Level = 0; Level < LevelCount; ++Level)
+      LevelOffsets[Level][Chunk] = LevelIndices[Level].entries();
+
+    for (exint x = First; x < Last; ++x) {
+      const exint Start = StripStarts[Order[x].second];
+      const exint End = StripEnds[Order[x].second];
+      for (exint y = Start; y < End; ++y) {
+        Box.enlargeBounds(Positions[Indices[y]]);
+        if (y > Start)
+          Length +=
+              (Positions[Indices[y]] - Positions[Indices[y - 1]]).length();
+      }
+      SegmentCount += End - Start - 1;
+
+      const int InnerCount = End - Start - 2;
+      for (int Level = 0; Level < LevelCount; ++Level) {
+        UT_Array<int> &Strips = LevelIndices[Level];
+        const int Step = 1 << Level;
+        Strips.append(Indices[Start]);
+        if (InnerCount < Step) {
+          if (InnerCount > 0)
+            Strips.append(Indices[Start + 1 + InnerCount / 2]);
+        } else {
+          for (int Inner = Step - 1; Inner < InnerCount; Inner += Step)
+            Strips.append(Indices[Start + 1 + Inner]);
+        }
+        Strips.append(Indices[End - 1]);
+        Strips.append(-1);
+      }
+    }
+    ChunkSegmentLengths[Chunk] = SegmentCount ? Length / SegmentCount : 0.0f;
+  }
+  for (int Level = 0; Level < LevelCount; ++Level)
+    LevelOffsets[Level][ChunkCount] = LevelIndices[Level].entries();
+
+  // chunks are in morton order, so splitting the list in halves gives a
+  // reasonable tree
+  Nodes.setCapacity(ChunkCount * 2);
+  buildNode(0, ChunkCount);
+}
+
+int IsolineChunks::buildNode(int FirstChunk, int LastChunk) {
+  const int NodeIndex = Nodes.append();
+  Nodes[NodeIndex].Children[0] = Nodes[NodeIndex].Children[1] = -1;
+  Nodes[NodeIndex].Chunk = -1;
+
+  if (LastChunk - FirstChunk == 1) {
+    Nodes[NodeIndex].Chunk = FirstChunk;
+    Nodes[NodeIndex].Box = ChunkBoxes[FirstChunk];
+    return NodeIndex;
+  }
+
+  const int Middle = (FirstChunk + LastChunk) / 2;
+  const int Left = buildNode(FirstChunk, Middle);
+  const int Right = buildNode(Middle, LastChunk);
+  Nodes[NodeIndex].Children[0] = Left;
+  Nodes[NodeIndex].Children[1] = Right;
+  Nodes[NodeIndex].Box = Nodes[Left].Box;
+  Nodes[NodeIndex].Box.enlargeBounds(Nodes[Right].Box);
+  return NodeIndex;
+}
+
+void IsolineChunks::selectLevels(const UT_Matrix4D &WorldToClip,
+                                 float ProjectionScale, float ViewportHeight,
+                                 float PixelSize,
+                                 UT_Array<int> &Levels) const {
+  Levels.setSize(chunkCount());
+  for (int x = 0; x < chunkCount(); ++x)
+    Levels[x] = -1;
+
+  if (Nodes.isEmpty())
+    return;
+
+  // screen pixels of a unit length at clip w of one
+  const float PixelScale = SYSabs(ProjectionScale) * ViewportHeight * 0.5f;
+
+  UT_Array<int> Stack;
+  Stack.append(0);
+  while (!Stack.isEmpty()) {
+    const Node &Current = Nodes[Stack.last()];
+    Stack.removeLast();
+
+    // outside when all corners are beyond the same clip plane
+    const UT_Vector3 Min = Current.Box.minvec();
+    const UT_Vector3 Max = Current.Box.maxvec();
+    int Outside[6] = {0, 0, 0, 0, 0, 0};
+    float MinW = SYS_FP32_MAX;
+    for (int Corner = 0; Corner < 8; ++Corner) {
+      const UT_Vector4D Point(Corner & 1 ? Max.x() : Min.x(),
+                              Corner & 2 ? Max.y() : Min.y(),
+                              Corner & 4 ? Max.z() : Min.z(), 1.0);
+      const UT_Vector4D Clip = Point * WorldToClip;
+      for (int Axis = 0; Axis < 3; ++Axis) {
+        Outside[Axis * 2] += Clip[Axis] < -Clip[3];
+        Outside[Axis * 2 + 1] += Clip[Axis] > Clip[3];
+      }
+      MinW = SYSmin(MinW, float(Clip[3]));
+    }
+    bool IsCulled = false;
+    for (int Plane = 0; Plane < 6; ++Plane)
+      IsCulled |= Outside[Plane] == 8;
+    if (IsCulled)
+      continue;
+
+    if (Current.Chunk < 0) {
+      Stack.append(Current.Children[0]);
+      Stack.append(Current.Children[1]);
+      continue;
+    }
+
+    // the nearest corner decides, a box reaching behind the eye keeps
+    // full detail
+    int Level = 0;
+    if (MinW > 0.0f) {
+      const float Pixels =
+          ChunkSegmentLengths[Current.Chunk] * PixelScale / MinW;
+      while (Level + 1 < levelCount() && Pixels * (2 << Level) <= PixelSize)
+        Level++;
+    }
+    Levels[Current.Chunk] = Level;
+  }
+}
+
+void IsolineChunks::gatherIndices(const UT_Array<int> &Levels,
+                                  UT_Array<int> &OutIndices) const {
+  OutIndices.clear();
+  for (int Chunk = 0; Chunk < chunkCount(); ++Chunk) {
+    const int Level = Levels[Chunk];
+    if (Level < 0)
+      continue;
+    const UT_Array<int> &Strips = LevelIndices[Level];
+    const exint Start = LevelOffsets[Level][Chunk];
+    const exint End = LevelOffsets[Level][Chunk + 1];
+    for (exint x = Start; x < End; ++x)
+      OutIndices.append(Strips[x]);
+  }
+}
+
+int64 IsolineChunks::getMemoryUsage() const {
+  int64 Usage = Nodes.getMemoryUsage() + ChunkBoxes.getMemoryUsage() +
+                ChunkSegmentLengths.getMemoryUsage();
+  for (int Level = 0; Level < levelCount(); ++Level)
+    Usage += LevelIndices[Level].getMemoryUsage() +
+             LevelOffsets[Level].getMemoryUsage();
+  return Usage;
+}
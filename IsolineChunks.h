@@ -0,0 +1,48 @@
+#pragma once
+
+#include <UT/UT_Array.h>
+#include <UT/UT_BoundingBox.h>
+#include <UT/UT_Matrix4.h>
+#include <UT/UT_Vector3.h>
+
+// Spatial hierarchy over isoline strips for viewport culling. Strips are
+// grouped by their morton code into chunks with a bbox tree on top, and
+// every chunk keeps coarser copies of its strips with fewer inner samples.
+class IsolineChunks {
+public:
+  // Indices are line strips ended by a negative restart index, one per edge
+  void build(const UT_Vector3FArray &Positions, const UT_Array<int> &Indices);
+
+  int chunkCount() const { return ChunkBoxes.entries(); }
+  int levelCount() const { return LevelIndices.entries(); }
+  int64 getMemoryUsage() const;
+
+  // level of every chunk for a view, -1 outside the frustum, 0 at full
+  // detail and coarser while a segment stays below PixelSize on screen.
+  // ProjectionScale is the (1, 1) term of the projection matrix alone, the
+  // combined matrix mixes in the camera rotation
+  void selectLevels(const UT_Matrix4D &WorldToClip, float ProjectionScale,
+                    float ViewportHeight, float PixelSize,
+                    UT_Array<int> &Levels) const;
+  // strips of the chunks at their selected level
+  void gatherIndices(const UT_Array<int> &Levels,
+                     UT_Array<int> &OutIndices) const;
+
+private:
+  struct Node {
+    UT_BoundingBox Box;
+    // leaves hold a chunk and no children
+    int Children[2];
+    int Chunk;
+  };
+
+  int buildNode(int FirstChunk, int LastChunk);
+
+  UT_Array<Node> Nodes;
+  UT_Array<UT_BoundingBox> ChunkBoxes;
+  // average full detail segment length of every chunk
+  UT_Array<float> ChunkSegmentLengths;
+  // strips of all chunks per level and where every chunk starts in them
+  UT_Array<UT_Array<int>> LevelIndices;
+  UT_Array<UT_Array<exint>> LevelOffsets;
+};
@@ -0,0 +1,186 @@
+#include "IsolineDiskCache.h"
+
+#include <UT/UT_WorkBuffer.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const char CacheMagic[8] = {'C', 'B', 'I', 'S', 'O', 'L', 'N', 'S'};
+const uint32 CacheVersion = 2;
+
+// the arrays follow the header in this order, all 4 byte aligned
+struct IsolineDiskCache::Header {
+  char Magic[8];
+  uint32 Version;
+  int32 SubdivisionLevel;
+  uint64 TopologyHash;
+  uint64 PositionHash;
+  int64 SampleCount;
+  int64 IndexCount;
+
+  exint positionsOffset() const { return sizeof(Header); }
+  exint normalsOffset() const {
+    return positionsOffset() + SampleCount * sizeof(UT_Vector3F);
+  }
+  exint indicesOffset() const {
+    return normalsOffset() + SampleCount * sizeof(UT_Vector3F);
+  }
+  exint fileSize() const { return indicesOffset() + IndexCount * sizeof(int); }
+};
+
+UT_StringHolder IsolineDiskCache::getPath(const UT_StringRef &Directory,
+                                          const Key &CacheKey) {
+  UT_WorkBuffer Path;
+  Path.sprintf("%s/%016llx_%016llx_%d.isolines", Directory.c_str(),
+               (unsigned long long)CacheKey.TopologyHash,
+               (unsigned long long)CacheKey.PositionHash,
+               CacheKey.SubdivisionLevel);
+  return UT_StringHolder(Path);
+}
+
+bool IsolineDiskCache::write(const UT_StringRef &Path, const Key &CacheKey,
+                             const UT_Vector3FArray &Positions,
+                             const UT_Vector3FArray &Normals,
+                             const UT_Array<int> &Indices) {
+  const exint SampleCount = Positions.entries();
+  if (Normals.entries() != SampleCount)
+    return false;
+
+  Header FileHeader;
+  memset(&FileHeader, 0, sizeof(FileHeader));
+  memcpy(FileHeader.Magic, CacheMagic, sizeof(CacheMagic));
+  FileHeader.Version = CacheVersion;
+  FileHeader.SubdivisionLevel = CacheKey.SubdivisionLevel;
+  FileHeader.TopologyHash = CacheKey.TopologyHash;
+  FileHeader.PositionHash = CacheKey.PositionHash;
+  FileHeader.SampleCount = SampleCount;
+  FileHeader.IndexCount = Indices.entries();
+
+  // written under a temporary name, a reader never maps half a file
+  UT_WorkBuffer TempPath;
+  TempPath.sprintf("%s.tmp", Path.c_str());
+  FILE *File = fopen(TempPath.buffer(), "wb");
+  if (!File)
+    return false;
+
+  bool IsWritten =
+      fwrite(&FileHeader, sizeof(FileHeader), 1, File) == 1 &&
+      fwrite(Positions.array(), sizeof(UT_Vector3F), SampleCount, File) ==
+          size_t(SampleCount) &&
+      fwrite(Normals.array(), sizeof(UT_Vector3F), SampleCount, File) ==
+          size_t(SampleCount) &&
+      fwrite(Indices.array(), sizeof(int), Indices.entries(), File) ==
+          size_t(Indices.entries());
+  IsWritten = fclose(File) == 0 && IsWritten;
+
+  // rename doesn't replace an existing file on windows
+  remove(Path.c_str());
+  if (!IsWritten || rename(TempPath.buffer(), Path.c_str()) != 0) {
+    remove(TempPath.buffer());
+    return false;
+  }
+  return true;
+}
+
+bool IsolineDiskCache::open(const UT_StringRef &Path, const Key &CacheKey) {
+  close();
+
+#ifdef _WIN32
+  HANDLE File = CreateFileA(Path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (File == INVALID_HANDLE_VALUE)
+    return false;
+  LARGE_INTEGER FileSize;
+  HANDLE Mapping = NULL;
+  if (GetFileSizeEx(File, &FileSize) && FileSize.QuadPart >= sizeof(Header))
+    Mapping = CreateFileMappingA(File, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (!Mapping) {
+    CloseHandle(File);
+    return false;
+  }
+  FileHandle = File;
+  MappingHandle = Mapping;
+  Size = FileSize.QuadPart;
+  Data = MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+  const int File = ::open(Path.c_str(), O_RDONLY);
+  if (File < 0)
+    return false;
+  struct stat FileStat;
+  if (fstat(File, &FileStat) == 0 &&
+      FileStat.st_size >= exint(sizeof(Header))) {
+    Size = FileStat.st_size;
+    Data = mmap(NULL, Size, PROT_READ, MAP_PRIVATE, File, 0);
+    if (Data == MAP_FAILED)
+      Data = NULL;
+  }
+  // the mapping stays valid without the descriptor
+  ::close(File);
+#endif
+
+  if (!Data) {
+    close();
+    return false;
+  }
+
+  const Header &FileHeader = *header();
+  if (memcmp(FileHeader.Magic, CacheMagic, sizeof(CacheMagic)) != 0 ||
+      FileHeader.Version != CacheVersion ||
+      FileHeader.SubdivisionLevel != CacheKey.SubdivisionLevel ||
+      FileHeader.TopologyHash != CacheKey.TopologyHash ||
+      FileHeader.PositionHash != CacheKey.PositionHash ||
+      FileHeader.SampleCount < 0 || FileHeader.IndexCount < 0 ||
+      FileHeader.fileSize() != Size) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void IsolineDiskCache::close() {
+#ifdef _WIN32
+  if (Data)
+    UnmapViewOfFile(Data);
+  if (MappingHandle)
+    CloseHandle(MappingHandle);
+  if (FileHandle)
+    CloseHandle(FileHandle);
+  FileHandle = MappingHandle = NULL;
+#else
+  if (Data)
+    munmap(Data, Size);
+#endif
+  Data = NULL;
+  Size = 0;
+}
+
+exint IsolineDiskCache::sampleCount() const {
+  return Data ? header()->SampleCount : 0;
+}
+
+exint IsolineDiskCache::indexCount() const {
+  return Data ? header()->IndexCount : 0;
+}
+
+const UT_Vector3F *IsolineDiskCache::positions() const {
+  return reinterpret_cast<const UT_Vector3F *>(
+      section(header()->positionsOffset()));
+}
+
+const UT_Vector3F *IsolineDiskCache::normals() const {
+  return reinterpret_cast<const UT_Vector3F *>(
+      section(header()->normalsOffset()));
+}
+
+const int *IsolineDiskCache::indices() const {
+  return reinterpret_cast<const int *>(section(header()->indicesOffset()));
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <SYS/SYS_Types.h>
+#include <UT/UT_Array.h>
+#include <UT/UT_StringHolder.h>
+#include <UT/UT_Vector3.h>
+
+// Isoline cache file, a fixed header followed by the limit sample
+// positions and normals and the strip indices. Creases come from the
+// topology. Files are read through a memory mapping, the arrays are used
+// where they lie without any parsing.
+class IsolineDiskCache {
+public:
+  // content the file was computed from, also part of its name
+  struct Key {
+    uint64 TopologyHash;
+    uint64 PositionHash;
+    int SubdivisionLevel;
+  };
+
+  IsolineDiskCache() {}
+  ~IsolineDiskCache() { close(); }
+  IsolineDiskCache(const IsolineDiskCache &) = delete;
+  IsolineDiskCache &operator=(const IsolineDiskCache &) = delete;
+
+  // file of the key inside the cache directory
+  static UT_StringHolder getPath(const UT_StringRef &Directory,
+                                 const Key &CacheKey);
+  static bool write(const UT_StringRef &Path, const Key &CacheKey,
+                    const UT_Vector3FArray &Positions,
+                    const UT_Vector3FArray &Normals,
+                    const UT_Array<int> &Indices);
+
+  // maps the file, false if it is missing, truncated or of another key
+  bool open(const UT_StringRef &Path, const Key &CacheKey);
+  void close();
+
+  exint sampleCount() const;
+  exint indexCount() const;
+  const UT_Vector3F *positions() const;
+  const UT_Vector3F *normals() const;
+  const int *indices() const;
+
+private:
+  struct Header;
+
+  const Header *header() const {
+    return reinterpret_cast<const Header *>(Data);
+  }
+  const char *section(exint Offset) const {
+    return reinterpret_cast<const char *>(Data) + Offset;
+  }
+
+  void *Data = NULL;
+  exint Size = 0;
+#ifdef _WIN32
+  void *FileHandle = NULL;
+  void *MappingHandle = NULL;
+#endif
+};
@@ -0,0 +1,95 @@
+#include "IsolineFingerprint.h"
+
+#include <GA/GA_Handle.h>
+#include <UT/UT_Array.h>
+#include <UT/UT_ParallelUtil.h>
+
+#include <string.h>
+
+// elements hashed per task, block hashes are combined in order so the
+// result doesn't depend on the scheduling
+const GA_Size HashBlockSize = 4096;
+
+namespace {
+const uint64 HashSeed = 14695981039346656037ULL;
+
+void hashWord(uint64 &Hash, uint32 Word) {
+  Hash = (Hash ^ Word) * 1099511628211ULL;
+}
+
+void hashFloat(uint64 &Hash, float Value) {
+  uint32 Word;
+  memcpy(&Word, &Value, sizeof(Word));
+  hashWord(Hash, Word);
+}
+
+template <typename BODY> uint64 hashBlocks(GA_Size Count, const BODY &Body) {
+  const GA_Size BlockCount = (Count + HashBlockSize - 1) / HashBlockSize;
+  UT_Array<uint64> BlockHashes;
+  BlockHashes.setSizeNoInit(BlockCount);
+
+  UTparallelFor(
+      UT_BlockedRange<GA_Size>(0, BlockCount),
+      [&](const UT_BlockedRange<GA_Size> &Range) {
+        for (GA_Size Block = Range.begin(); Block != Range.end(); ++Block) {
+          uint64 Hash = HashSeed;
+          const GA_Size End = SYSmin((Block + 1) * HashBlockSize, Count);
+          for (GA_Size x = Block * HashBlockSize; x < End; ++x)
+            Body(Hash, x);
+          BlockHashes[Block] = Hash;
+        }
+      });
+
+  uint64 Hash = HashSeed;
+  hashWord(Hash, uint32(Count));
+  for (GA_Size Block = 0; Block < BlockCount; ++Block) {
+    hashWord(Hash, uint32(BlockHashes[Block]));
+    hashWord(Hash, uint32(BlockHashes[Block] >> 32));
+  }
+  return Hash;
+}
+} // namespace
+
+uint64 IsolineFingerprint::hashTopology(const GU_Detail *Gdp) {
+  const GA_ROHandleF CreaseHandle(Gdp->findVertexAttribute("creaseweight"));
+  const GA_ROHandleF CornerHandle(Gdp->findPointAttribute("cornerweight"));
+  const GA_ROHandleI HoleHandle(
+      Gdp->findPrimitiveAttribute("subdivision_hole"));
+
+  uint64 Hash = hashBlocks(
+      Gdp->getNumPrimitives(), [&](uint64 &BlockHash, GA_Size Face) {
+        const GA_Offset FaceOffset = Gdp->primitiveOffset(Face);
+        const GA_OffsetListRef Vertices =
+            Gdp->getPrimitiveVertexList(FaceOffset);
+        hashWord(BlockHash, uint32(Vertices.entries()));
+        if (HoleHandle.isValid())
+          hashWord(BlockHash, uint32(HoleHandle(FaceOffset) != 0));
+        for (GA_Size x = 0; x < Vertices.entries(); ++x) {
+          const GA_Offset VertexOffset = Vertices.get(x);
+          hashWord(BlockHash,
+                   uint32(Gdp->pointIndex(Gdp->vertexPoint(VertexOffset))));
+          if (CreaseHandle.isValid())
+            hashFloat(BlockHash, CreaseHandle(VertexOffset));
+        }
+      });
+  hashWord(Hash, uint32(Gdp->getNumPoints()));
+
+  if (CornerHandle.isValid()) {
+    const uint64 CornerHash = hashBlocks(
+        Gdp->getNumPoints(), [&](uint64 &BlockHash, GA_Size x) {
+          hashFloat(BlockHash, CornerHandle(Gdp->pointOffset(x)));
+        });
+    hashWord(Hash, uint32(CornerHash));
+    hashWord(Hash, uint32(CornerHash >> 32));
+  }
+  return Hash;
+}
+
+uint64 IsolineFingerprint::hashPositions(const GU_Detail *Gdp) {
+  return hashBlocks(Gdp->getNumPoints(), [&](uint64 &BlockHash, GA_Size x) {
+    const UT_Vector3 Position = Gdp->getPos3(Gdp->pointOffset(x));
+    hashFloat(BlockHash, Position.x());
+    hashFloat(BlockHash, Position.y());
+    hashFloat(BlockHash, Position.z());
+  });
+}
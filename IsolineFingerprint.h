@@ -0,0 +1,15 @@
+#pragma once
+
+#include <GU/GU_Detail.h>
+#include <SYS/SYS_Types.h>
+
+// Content hashes of a detail. Recooks to identical geometry get new data
+// ids, the hashes tell them apart from real changes. Topology and
+// positions are hashed separately, so a deformation still reuses the
+// topology.
+namespace IsolineFingerprint {
+// point count, vertex lists and creaseweight of every primitive
+uint64 hashTopology(const GU_Detail *Gdp);
+// positions of every point
+uint64 hashPositions(const GU_Detail *Gdp);
+} // namespace IsolineFingerprint
@@ -0,0 +1,386 @@
+#include "IsolineLimitEvaluator.h"
+
+#include <UT/UT_ParallelUtil.h>
+
+#include <opensubdiv/far/patchTableFactory.h>
+#include <opensubdiv/far/stencilTableFactory.h>
+#include <opensubdiv/far/topologyDescriptor.h>
+
+#include <algorithm>
+
+using namespace OpenSubdiv;
+
+// adaptive isolation depth around extraordinary vertices and creases
+const int IsolationLevel = 4;
+// largest patch basis, a gregory basis end cap
+const int MaxPatchPoints = 20;
+
+void IsolineLimitEvaluator::setupTopology(const IsolineTopology &Topology,
+                                          bool UseCreases) {
+  typedef Far::TopologyDescriptor Descriptor;
+
+  UT_Array<int> VertexCounts;
+  VertexCounts.setSizeNoInit(Topology.faceCount());
+  for (int Face = 0; Face < Topology.faceCount(); ++Face)
+    VertexCounts[Face] = Topology.faceSize(Face);
+
+  UT_Array<int> CreasePoints;
+  UT_Array<float> CreaseWeights;
+  for (exint x = 0; UseCreases && x < Topology.edgeCount(); ++x) {
+    const IsolineTopology::Edge &Edge = Topology.edge(x);
+    if (Edge.Crease <= 0.0f)
+      continue;
+    CreasePoints.append(Edge.Points[0]);
+    CreasePoints.append(Edge.Points[1]);
+    CreaseWeights.append(Edge.Crease);
+  }
+
+  Descriptor Desc;
+  Desc.numVertices = Topology.pointCount();
+  Desc.numFaces = Topology.faceCount();
+  Desc.numVertsPerFace = VertexCounts.getArray();
+  Desc.vertIndicesPerFace = Topology.facePoints().getArray();
+  Desc.numCreases = CreaseWeights.entries();
+  Desc.creaseVertexIndexPairs = CreasePoints.getArray();
+  Desc.creaseWeights = CreaseWeights.getArray();
+  // corners and holes shape the surface whether creases are shown or not
+  Desc.numCorners = Topology.cornerPoints().entries();
+  Desc.cornerVertexIndices = Topology.cornerPoints().getArray();
+  Desc.cornerWeights = Topology.cornerWeights().getArray();
+  Desc.numHoles = Topology.holeFaces().entries();
+  Desc.holeIndices = Topology.holeFaces().getArray();
+
+  Sdc::Options SdcOptions;
+  SdcOptions.SetVtxBoundaryInterpolation(
+      Sdc::Options::VTX_BOUNDARY_EDGE_AND_CORNER);
+
+  Refiner.reset(Far::TopologyRefinerFactory<Descriptor>::Create(
+      Desc, Far::TopologyRefinerFactory<Descriptor>::Options(
+                Sdc::SCHEME_CATMARK, SdcOptions)));
+  ControlPointCount = Topology.pointCount();
+  Patches.reset();
+  PatchMap.reset();
+  Stencils.reset();
+  Handles.clear();
+  clearSampleStencils();
+
+  if (!Refiner)
+    return;
+
+  Refiner->RefineAdaptive(
+      Far::TopologyRefiner::AdaptiveOptions(IsolationLevel));
+
+  Far::PatchTableFactory::Options PatchOptions;
+  PatchOptions.SetEndCapType(
+      Far::PatchTableFactory::Options::ENDCAP_GREGORY_BASIS);
+  Patches.reset(Far::PatchTableFactory::Create(*Refiner, PatchOptions));
+  PatchMap.reset(new Far::PatchMap(*Patches));
+
+  // intermediate levels are factorized away, so every stencil only
+  // references control points and they can be applied in any order
+  Far::StencilTableFactory::Options StencilOptions;
+  StencilOptions.generateIntermediateLevels = true;
+  StencilOptions.generateOffsets = true;
+  UT_UniquePtr<const Far::StencilTable> RefinedStencils(
+      Far::StencilTableFactory::Create(*Refiner, StencilOptions));
+
+  const Far::StencilTable *LocalStencils =
+      Patches->GetLocalPointStencilTable();
+  if (LocalStencils)
+    Stencils.reset(Far::StencilTableFactory::AppendLocalPointStencilTable(
+        *Refiner, RefinedStencils.get(), LocalStencils));
+  else
+    Stencils = std::move(RefinedStencils);
+}
+
+IsolineLimitEvaluator::PatchHandle
+IsolineLimitEvaluator::findPatch(int Face, float U, float V) const {
+  const PatchHandle *Handle =
+      PatchMap && Face >= 0 ? PatchMap->FindPatch(Face, U, V) : NULL;
+  if (Handle)
+    return *Handle;
+
+  // holes and samples without a face evaluate to the origin
+  PatchHandle Missing;
+  Missing.arrayIndex = Missing.vertIndex = 0;
+  Missing.patchIndex = -1;
+  return Missing;
+}
+
+void IsolineLimitEvaluator::setupSamples(const UT_Array<int> &Faces,
+                                         const UT_Array<float> &U,
+                                         const UT_Array<float> &V) {
+  SampleU = U;
+  SampleV = V;
+  Handles.setSizeNoInit(Faces.entries());
+  clearSampleStencils();
+
+  UTparallelFor(
+      UT_BlockedRange<exint>(0, Faces.entries()),
+      [&](const UT_BlockedRange<exint> &Range) {
+        for (exint x = Range.begin(); x != Range.end(); ++x)
+          Handles[x] = findPatch(Faces[x], U[x], V[x]);
+      });
+}
+
+void IsolineLimitEvaluator::remapSamples(const UT_Array<exint> &Sources,
+                                         const UT_Array<int> &Faces,
+                                         const UT_Array<float> &U,
+                                         const UT_Array<float> &V) {
+  UT_Array<PatchHandle> NewHandles;
+  NewHandles.setSizeNoInit(Faces.entries());
+
+  UTparallelFor(
+      UT_BlockedRange<exint>(0, Faces.entries()),
+      [&](const UT_BlockedRange<exint> &Range) {
+        for (exint x = Range.begin(); x != Range.end(); ++x)
+          NewHandles[x] = Sources[x] >= 0
+                              ? Handles[Sources[x]]
+                              : findPatch(Faces[x], U[x], V[x]);
+      });
+
+  Handles.swap(NewHandles);
+  SampleU = U;
+  SampleV = V;
+  clearSampleStencils();
+}
+
+void IsolineLimitEvaluator::updateControlPoints(
+    const UT_Vector3FArray &Values, UT_Vector3FArray &PatchPoints) const {
+  const exint StencilCount = Stencils ? Stencils->GetNumStencils() : 0;
+  PatchPoints.setSizeNoInit(ControlPointCount + StencilCount);
+  for (int x = 0; x < ControlPointCount; ++x)
+    PatchPoints[x] = Values[x];
+
+  if (!StencilCount)
+    return;
+
+  const std::vector<int> &Sizes = Stencils->GetSizes();
+  const std::vector<Far::Index> &Offsets = Stencils->GetOffsets();
+  const std::vector<Far::Index> &Indices = Stencils->GetControlIndices();
+  const std::vector<float> &Weights = Stencils->GetWeights();
+
+  UTparallelFor(
+      UT_BlockedRange<exint>(0, StencilCount),
+      [&](const UT_BlockedRange<exint> &Range) {
+        for (exint x = Range.begin(); x != Range.end(); ++x) {
+          UT_Vector3F Point(0.0f, 0.0f, 0.0f);
+          const int End = Offsets[x] + Sizes[x];
+          for (int y = Offsets[x]; y < End; ++y)
+            Point += Values[Indices[y]] * Weights[y];
+          PatchPoints[ControlPointCount + x] = Point;
+        }
+      });
+}
+
+void IsolineLimitEvaluator::evaluateHandle(
+    const UT_Vector3FArray &PatchPoints, const PatchHandle &Handle, float U,
+    float V, UT_Vector3F &Position, UT_Vector3F &Normal) const {
+  float Weights[MaxPatchPoints];
+  float DsWeights[MaxPatchPoints];
+  float DtWeights[MaxPatchPoints];
+
+  UT_Vector3F Point(0.0f, 0.0f, 0.0f);
+  UT_Vector3F Ds(0.0f, 0.0f, 0.0f);
+  UT_Vector3F Dt(0.0f, 0.0f, 0.0f);
+  if (Handle.patchIndex >= 0) {
+    Patches->EvaluateBasis(Handle, U, V, Weights, DsWeights, DtWeights);
+    const Far::ConstIndexArray Points = Patches->GetPatchVertices(Handle);
+    for (int y = 0; y < Points.size(); ++y) {
+      const UT_Vector3F &PatchPoint = PatchPoints[Points[y]];
+      Point += PatchPoint * Weights[y];
+      Ds += PatchPoint * DsWeights[y];
+      Dt += PatchPoint * DtWeights[y];
+    }
+  }
+  // ptex faces follow the vertex order, houdini's clockwise winding puts
+  // the outside on the t x s side
+  Normal = cross(Dt, Ds);
+  Normal.normalize();
+  Position = Point;
+}
+
+void IsolineLimitEvaluator::evaluate(const UT_Vector3FArray &PatchPoints,
+                                     UT_Vector3FArray &LimitPositions,
+                                     UT_Vector3FArray &LimitNormals) const {
+  LimitPositions.setSizeNoInit(Handles.entries());
+  LimitNormals.setSizeNoInit(Handles.entries());
+
+  UTparallelFor(
+      UT_BlockedRange<exint>(0, Handles.entries()),
+      [&](const UT_BlockedRange<exint> &Range) {
+        for (exint x = Range.begin(); x != Range.end(); ++x)
+          evaluateHandle(PatchPoints, Handles[x], SampleU[x], SampleV[x],
+                         LimitPositions[x], LimitNormals[x]);
+      });
+}
+
+void IsolineLimitEvaluator::evaluateSamples(
+    const UT_Vector3FArray &PatchPoints, const UT_Array<exint> &Samples,
+    UT_Vector3FArray &LimitPositions, UT_Vector3FArray &LimitNormals) const {
+  UTparallelFor(
+      UT_BlockedRange<exint>(0, Samples.entries()),
+      [&](const UT_BlockedRange<exint> &Range) {
+        for (exint x = Range.begin(); x != Range.end(); ++x) {
+          const exint Sample = Samples[x];
+          evaluateHandle(PatchPoints, Handles[Sample], SampleU[Sample],
+                         SampleV[Sample], LimitPositions[Sample],
+                         LimitNormals[Sample]);
+        }
+      });
+}
+
+void IsolineLimitEvaluator::evaluatePoint(const UT_Vector3FArray &PatchPoints,
+                                          int Face, float U, float V,
+                                          UT_Vector3F &Position,
+                                          UT_Vector3F &Normal) const {
+  evaluateHandle(PatchPoints, findPatch(Face, U, V), U, V, Position, Normal);
+}
+
+void IsolineLimitEvaluator::gatherSampleStencil(
+    exint Sample, UT_Array<StencilEntry> &Entries) const {
+  Entries.clear();
+  const PatchHandle &Handle = Handles[Sample];
+  if (Handle.patchIndex < 0)
+    return;
+
+  float Weights[MaxPatchPoints];
+  float DsWeights[MaxPatchPoints];
+  float DtWeights[MaxPatchPoints];
+  Patches->EvaluateBasis(Handle, SampleU[Sample], SampleV[Sample], Weights,
+                         DsWeights, DtWeights);
+
+  // refined and local points expand into their control point stencils
+  const Far::ConstIndexArray Points = Patches->GetPatchVertices(Handle);
+  for (int y = 0; y < Points.size(); ++y) {
+    if (Points[y] < ControlPointCount) {
+      Entries.append({Points[y], Weights[y], DsWeights[y], DtWeights[y]});
+      continue;
+    }
+    const Far::Stencil PointStencil =
+        Stencils->GetStencil(Points[y] - ControlPointCount);
+    const Far::Index *Indices = PointStencil.GetVertexIndices();
+    const float *PointWeights = PointStencil.GetWeights();
+    for (int z = 0; z < PointStencil.GetSize(); ++z)
+      Entries.append({Indices[z], Weights[y] * PointWeights[z],
+                      DsWeights[y] * PointWeights[z],
+                      DtWeights[y] * PointWeights[z]});
+  }
+
+  // neighbouring patch points share most of their control points
+  std::sort(Entries.begin(), Entries.end(),
+            [](const StencilEntry &A, const StencilEntry &B) {
+              return A.Index < B.Index;
+            });
+  exint Last = 0;
+  for (exint x = 1; x < Entries.entries(); ++x) {
+    if (Entries[x].Index == Entries[Last].Index) {
+      Entries[Last].Weight += Entries[x].Weight;
+      Entries[Last].DsWeight += Entries[x].DsWeight;
+      Entries[Last].DtWeight += Entries[x].DtWeight;
+    } else {
+      Entries[++Last] = Entries[x];
+    }
+  }
+  Entries.setSize(Entries.isEmpty() ? 0 : Last + 1);
+}
+
+void IsolineLimitEvaluator::setupSampleStencils() {
+  clearSampleStencils();
+  if (!Patches)
+    return;
+
+  // sizes first, then every stencil is gathered again straight into place,
+  // cheaper than keeping a separate array per sample around
+  const exint SampleCount = Handles.entries();
+  SampleStencilOffsets.setSizeNoInit(SampleCount + 1);
+  UTparallelFor(
+      UT_BlockedRange<exint>(0, SampleCount),
+      [&](const UT_BlockedRange<exint> &Range) {
+        UT_Array<StencilEntry> Entries;
+        for (exint x = Range.begin(); x != Range.end(); ++x) {
+          gatherSampleStencil(x, Entries);
+          SampleStencilOffsets[x + 1] = Entries.entries();
+        }
+      });
+  SampleStencilOffsets[0] = 0;
+  for (exint x = 0; x < SampleCount; ++x)
+    SampleStencilOffsets[x + 1] += SampleStencilOffsets[x];
+
+  const exint EntryCount = SampleStencilOffsets[SampleCount];
+  SampleStencilIndices.setSizeNoInit(EntryCount);
+  SampleWeights.setSizeNoInit(EntryCount);
+  SampleDsWeights.setSizeNoInit(EntryCount);
+  SampleDtWeights.setSizeNoInit(EntryCount);
+  UTparallelFor(
+      UT_BlockedRange<exint>(0, SampleCount),
+      [&](const UT_BlockedRange<exint> &Range) {
+        UT_Array<StencilEntry> Entries;
+        for (exint x = Range.begin(); x != Range.end(); ++x) {
+          gatherSampleStencil(x, Entries);
+          const exint Offset = SampleStencilOffsets[x];
+          for (exint y = 0; y < Entries.entries(); ++y) {
+            SampleStencilIndices[Offset + y] = Entries[y].Index;
+            SampleWeights[Offset + y] = Entries[y].Weight;
+            SampleDsWeights[Offset + y] = Entries[y].DsWeight;
+            SampleDtWeights[Offset + y] = Entries[y].DtWeight;
+          }
+        }
+      });
+  HasSampleStencils = true;
+}
+
+void IsolineLimitEvaluator::evaluateStencils(
+    const UT_Vector3FArray &Values, UT_Vector3FArray &LimitPositions,
+    UT_Vector3FArray &LimitNormals) const {
+  const exint SampleCount = SampleStencilOffsets.entries() - 1;
+  LimitPositions.setSizeNoInit(SampleCount);
+  LimitNormals.setSizeNoInit(SampleCount);
+
+  UTparallelFor(
+      UT_BlockedRange<exint>(0, SampleCount),
+      [&](const UT_BlockedRange<exint> &Range) {
+        for (exint x = Range.begin(); x != Range.end(); ++x) {
+          UT_Vector3F Point(0.0f, 0.0f, 0.0f);
+          UT_Vector3F Ds(0.0f, 0.0f, 0.0f);
+          UT_Vector3F Dt(0.0f, 0.0f, 0.0f);
+          const exint End = SampleStencilOffsets[x + 1];
+          for (exint y = SampleStencilOffsets[x]; y < End; ++y) {
+            const UT_Vector3F &Value = Values[SampleStencilIndices[y]];
+            Point += Value * SampleWeights[y];
+            Ds += Value * SampleDsWeights[y];
+            Dt += Value * SampleDtWeights[y];
+          }
+          // same winding as evaluateHandle
+          UT_Vector3F Normal = cross(Dt, Ds);
+          Normal.normalize();
+          LimitPositions[x] = Point;
+          LimitNormals[x] = Normal;
+        }
+      });
+}
+
+void IsolineLimitEvaluator::clearSampleStencils() {
+  HasSampleStencils = false;
+  SampleStencilOffsets.clear();
+  SampleStencilIndices.clear();
+  SampleWeights.clear();
+  SampleDsWeights.clear();
+  SampleDtWeights.clear();
+}
+
+int64 IsolineLimitEvaluator::getMemoryUsage() const {
+  int64 Usage = Handles.getMemoryUsage() + SampleU.getMemoryUsage() +
+                SampleV.getMemoryUsage() +
+                SampleStencilOffsets.getMemoryUsage() +
+                SampleStencilIndices.getMemoryUsage() +
+                SampleWeights.getMemoryUsage() +
+                SampleDsWeights.getMemoryUsage() +
+                SampleDtWeights.getMemoryUsage();
+  if (Stencils)
+    Usage += Stencils->GetWeights().size() *
+             (sizeof(float) + sizeof(Far::Index));
+  if (Patches)
+    Usage += Patches->GetNumControlVerticesTotal() * sizeof(Far::Index);
+  return Usage;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "IsolineTopology.h"
+
+#include <UT/UT_Array.h>
+#include <UT/UT_UniquePtr.h>
+#include <UT/UT_Vector3.h>
+
+#include <opensubdiv/far/patchMap.h>
+#include <opensubdiv/far/patchTable.h>
+#include <opensubdiv/far/stencilTable.h>
+#include <opensubdiv/far/topologyRefiner.h>
+
+// Catmull-Clark limit surface evaluator built on the OpenSubdiv Far API.
+// Refiner, patch table and patch lookups of the samples only depend on the
+// topology, so a deforming mesh just refreshes its control points.
+class IsolineLimitEvaluator {
+public:
+  typedef OpenSubdiv::Far::PatchTable::PatchHandle PatchHandle;
+
+  // builds the refiner, patch table and patch map of the topology
+  void setupTopology(const IsolineTopology &Topology, bool UseCreases);
+  // finds the patch of every (ptex face, s, t) sample
+  void setupSamples(const UT_Array<int> &Faces, const UT_Array<float> &U,
+                    const UT_Array<float> &V);
+  // like setupSamples, but samples with a previous index in Sources reuse
+  // the patch found for them and only the ones at -1 are looked up
+  void remapSamples(const UT_Array<exint> &Sources, const UT_Array<int> &Faces,
+                    const UT_Array<float> &U, const UT_Array<float> &V);
+  // computes refined and local patch points from control point positions
+  void updateControlPoints(const UT_Vector3FArray &Values,
+                           UT_Vector3FArray &PatchPoints) const;
+  // evaluates limit positions and normals of every sample in one pass,
+  // normals come from the limit derivatives
+  void evaluate(const UT_Vector3FArray &PatchPoints,
+                UT_Vector3FArray &LimitPositions,
+                UT_Vector3FArray &LimitNormals) const;
+  // evaluates only the listed samples, the arrays already hold all samples
+  void evaluateSamples(const UT_Vector3FArray &PatchPoints,
+                       const UT_Array<exint> &Samples,
+                       UT_Vector3FArray &LimitPositions,
+                       UT_Vector3FArray &LimitNormals) const;
+
+  // builds the limit stencil of every sample, position and derivative
+  // weights over the control points, so a deforming mesh is evaluated
+  // without refined points, patch lookups or basis evaluation
+  void setupSampleStencils();
+  // sample stencils are dropped whenever the samples or topology change,
+  // and never built without a patch table
+  bool hasSampleStencils() const { return HasSampleStencils; }
+  // evaluates every sample from the control point positions through the
+  // sample stencils
+  void evaluateStencils(const UT_Vector3FArray &Values,
+                        UT_Vector3FArray &LimitPositions,
+                        UT_Vector3FArray &LimitNormals) const;
+
+  // heap bytes of the sample tables and stencils, the refiner and patch
+  // table are estimated from their point counts
+  int64 getMemoryUsage() const;
+
+  // evaluates a single (ptex face, s, t) outside the sample table
+  void evaluatePoint(const UT_Vector3FArray &PatchPoints, int Face, float U,
+                     float V, UT_Vector3F &Position,
+                     UT_Vector3F &Normal) const;
+
+private:
+  struct StencilEntry {
+    int Index;
+    float Weight, DsWeight, DtWeight;
+  };
+
+  PatchHandle findPatch(int Face, float U, float V) const;
+  void evaluateHandle(const UT_Vector3FArray &PatchPoints,
+                      const PatchHandle &Handle, float U, float V,
+                      UT_Vector3F &Position, UT_Vector3F &Normal) const;
+  // limit stencil of a sample sorted by control point, one entry each
+  void gatherSampleStencil(exint Sample,
+                           UT_Array<StencilEntry> &Entries) const;
+  void clearSampleStencils();
+
+  UT_UniquePtr<OpenSubdiv::Far::TopologyRefiner> Refiner;
+  UT_UniquePtr<const OpenSubdiv::Far::PatchTable> Patches;
+  UT_UniquePtr<const OpenSubdiv::Far::PatchMap> PatchMap;
+  // refined and local points as combinations of the control points
+  UT_UniquePtr<const OpenSubdiv::Far::StencilTable> Stencils;
+  int ControlPointCount = 0;
+
+  UT_Array<PatchHandle> Handles;
+  UT_Array<float> SampleU, SampleV;
+
+  // stencil of sample x spans SampleStencilOffsets[x] up to the next offset
+  bool HasSampleStencils = false;
+  UT_Array<exint> SampleStencilOffsets;
+  UT_Array<int> SampleStencilIndices;
+  UT_Array<float> SampleWeights, SampleDsWeights, SampleDtWeights;
+};
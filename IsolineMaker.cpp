@@ -1,256 +1,1040 @@
 #include "IsolineMaker.h"
 #include "GeometryUtilities.h"
+#include "IsolineDiskCache.h"
+#include "IsolineFingerprint.h"
+#include "IsolineLimitEvaluator.h"
+#include <GA/GA_Handle.h>
+#include <GA/GA_SplittableRange.h>
+#include <GEO/GEO_PolyCounts.h>
 #include <GEO/GEO_PrimPoly.h>
-#include <GT/GT_GEODetail.h>
-#include <GT/GT_PrimSubdivisionMesh.h>
-#include <GT/GT_Util.h>
-#include <GT/GT_UtilOpenSubdiv.h>
-
-IsolineMaker::IsolineMaker(GU_DetailHandle GdpHandle, float Peak,
-                           int SubdivisionLevel)
-    : Transform(UT_Matrix4D(1.f)), Peak(Peak),
-      SubdivisionLevel(SubdivisionLevel), UsesTransform(false) {
-  this->GdpHandle = GdpHandle;
+#include <UT/UT_ParallelUtil.h>
+
+#include <functional>
+#include <string.h>
+
+namespace {
+// data id of an optional attribute
+GA_DataId getDataId(const GA_Attribute *Attribute) {
+  return Attribute ? Attribute->getDataId() : GA_INVALID_DATAID;
 }
+} // namespace
+
+IsolineMaker::IsolineMaker() {}
 
-IsolineMaker::IsolineMaker(GU_DetailHandle GdpHandle, UT_DMatrix4 Transform,
-                           float Peak, int SubdivisionLevel)
-    : Transform(Transform), Peak(Peak), SubdivisionLevel(SubdivisionLevel),
-      UsesTransform(true) {
+IsolineMaker::~IsolineMaker() {}
+
+void IsolineMaker::setDetail(const GU_ConstDetailHandle &GdpHandle) {
   this->GdpHandle = GdpHandle;
 }
 
+void IsolineMaker::setTransform(const UT_DMatrix4 &Transform) {
+  this->Transform = Transform;
+  UsesTransform = true;
+}
+
+void IsolineMaker::setPeak(float Peak) { this->Peak = Peak; }
+
+void IsolineMaker::setSubdivisionLevel(int SubdivisionLevel) {
+  this->SubdivisionLevel = SubdivisionLevel;
+}
+
+void IsolineMaker::setTolerance(float Tolerance) {
+  this->Tolerance = Tolerance;
+}
+
+void IsolineMaker::setChainEdges(bool ChainEdges) {
+  this->ChainEdges = ChainEdges;
+}
+
+void IsolineMaker::setUseStencils(bool UseStencils) {
+  this->UseStencils = UseStencils;
+}
+
+void IsolineMaker::setCacheDirectory(const UT_StringHolder &CacheDirectory) {
+  this->CacheDirectory = CacheDirectory;
+}
+
+void IsolineMaker::setCancelFlag(const SYS_AtomicInt32 *CancelFlag) {
+  this->CancelFlag = CancelFlag;
+}
+
 bool IsolineMaker::calculateAttributeArrays() {
   if (!isValidGeo())
     return false;
 
-  Positions.clear();
-  Colors.clear();
-  Normals.clear();
+  // every stage invalidates the ones after it and only records its own
+  // state once it is complete, so a cancelled run leaves a usable cache
+  if (hasTopologyChanged())
+    updateTopology();
+  if (isCancelled())
+    return false;
 
-  FaceIndices.clear();
-  ReferenceIndices.clear();
-  U.clear();
-  V.clear();
+  // a cache file of this content stands in for the limit evaluator until
+  // the shape or the level change
+  PositionId = getPositionId();
+  const bool IsAdaptive = Tolerance > 0.0f;
+  if (!HasEvaluatorTopology &&
+      (SubdivisionLevel != CachedSubdivisionLevel ||
+       IsAdaptive != CachedAdaptive || PositionId != CachedPositionId)) {
+    if (!IsAdaptive && readCacheFile()) {
+      CachedSubdivisionLevel = SubdivisionLevel;
+      CachedAdaptive = false;
+      CachedPositionId = PositionId;
+      BboxScale = getBboxScale();
+      LayoutVersion++;
+      LimitVersion++;
+    } else {
+      // samples are looked up again on the new patches
+      Evaluator->setupTopology(Topology, HasCrease);
+      HasEvaluatorTopology = true;
+      CachedSubdivisionLevel = -1;
+    }
+  }
+  if (isCancelled())
+    return false;
 
-  fillAttributeArrays();
-  getLimitSurfacePositions();
-  applyLimitSurfacePositions();
+  // adaptive samples follow the shape, so a deformation lays them out again
+  if (SubdivisionLevel != CachedSubdivisionLevel ||
+      IsAdaptive != CachedAdaptive ||
+      (IsAdaptive &&
+       (Tolerance != CachedTolerance || PositionId != CachedPositionId))) {
+    if (IsAdaptive)
+      fillAdaptiveAttributeArrays();
+    else
+      updateSubdivisionLevel();
+    CachedSubdivisionLevel = SubdivisionLevel;
+    CachedAdaptive = IsAdaptive;
+    CachedTolerance = Tolerance;
+    LayoutVersion++;
+    LimitVersion++;
+  }
+  if (isCancelled())
+    return false;
+
+  // a pure deformation keeps the patches and only refreshes control points,
+  // peak and transform changes skip straight to the offset pass
+  if (PositionId != CachedPositionId) {
+    getLimitSurfacePositions();
+    BboxScale = getBboxScale();
+    CachedPositionId = PositionId;
+    LimitVersion++;
+  }
+  if (isCancelled())
+    return false;
+
+  // a recook to the same content leaves the arrays and their version alone
+  if (LimitVersion != AppliedLimitVersion || Peak != AppliedPeak ||
+      Transform != AppliedTransform) {
+    applyLimitSurfacePositions();
+    AppliedLimitVersion = LimitVersion;
+    AppliedPeak = Peak;
+    AppliedTransform = Transform;
+    ArraysVersion++;
+  }
   return true;
 }
 
-void IsolineMaker::getLimitSurfacePositions() {
-  GU_ConstDetailHandle ConstDetailHandle = GU_ConstDetailHandle(GdpHandle);
-  GT_PrimitiveHandle Mesh = GT_GEODetail::makePolygonMesh(ConstDetailHandle);
-  const GT_PrimPolygonMesh &PrimPolyMesh =
-      *(const GT_PrimPolygonMesh *)(Mesh.get());
-  GT_PrimSubdivisionMesh PrimSubdivMesh(PrimPolyMesh,
-                                        GT_Scheme::GT_CATMULL_CLARK);
-  if (HasCrease) {
-    GT_DataArrayHandle EdgeIndices;
-    GT_DataArrayHandle EdgeSharpness;
-    GT_DataArrayHandle CornerIndices;
-    GT_DataArrayHandle CornerSharpness;
-    GT_DataArrayHandle HoleIndices;
-
-    GT_Util::computeSubdivisionCreases(PrimPolyMesh, EdgeIndices, EdgeSharpness,
-                                       CornerIndices, CornerSharpness,
-                                       HoleIndices);
-
-    GT_PrimSubdivisionMesh::Tag CreaseTag("crease");
-    GT_PrimSubdivisionMesh::Tag CornerTag("corner");
-
-    CreaseTag.appendInt(EdgeIndices);
-    CreaseTag.appendReal(EdgeSharpness);
-    PrimSubdivMesh.appendTag(CreaseTag);
-
-    CornerTag.appendInt(CornerIndices);
-    CornerTag.appendReal(CornerSharpness);
-    PrimSubdivMesh.appendTag(CornerTag);
+bool IsolineMaker::getCageArrays(UT_Vector3FArray &OutPositions,
+                                 UT_Vector3FArray &OutNormals,
+                                 UT_Array<float> &OutCreases,
+                                 UT_Array<int> &OutIndices) {
+  if (!isValidGeo() || !hasTopologyChanged())
+    return false;
+
+  // the index is the one calculateAttributeArrays goes on with, the
+  // evaluator is only set up from it there
+  updateTopology();
+
+  const int PointCount = Topology.pointCount();
+  const UT_Matrix4F PointTransform(Transform);
+  OutPositions.setSizeNoInit(PointCount);
+  for (GA_Index PointIndex = 0; PointIndex < PointCount; ++PointIndex) {
+    OutPositions[PointIndex] = gdp()->getPos3(gdp()->pointOffset(PointIndex));
+    if (UsesTransform)
+      OutPositions[PointIndex] *= PointTransform;
   }
 
-  GT_UtilOpenSubdiv Osd;
-  Osd.setupLimitEval(PrimSubdivMesh.createPointNormalsIfMissing());
+  // zero normals never fail the facing test, creases show on the next level
+  OutNormals.setSizeNoInit(PointCount);
+  OutNormals.constant(UT_Vector3F(0.0f, 0.0f, 0.0f));
+  OutCreases.setSizeNoInit(PointCount);
+  OutCreases.constant(0.0f);
+
+  OutIndices.setSizeNoInit(Topology.edgeCount() * 3);
+  for (exint x = 0; x < Topology.edgeCount(); ++x) {
+    OutIndices[x * 3] = Topology.edge(x).Points[0];
+    OutIndices[x * 3 + 1] = Topology.edge(x).Points[1];
+    OutIndices[x * 3 + 2] = StripRestartIndex;
+  }
+  return true;
+}
 
-  GT_UtilOpenSubdiv::AttribId Attribute = Osd.limitFindAttribute("uv");
+IsolineMaker::TopologyIds IsolineMaker::getTopologyIds() {
+  TopologyIds Ids;
+  Ids.Topology = gdp()->getTopology().getDataId();
+  Ids.PrimitiveList = gdp()->getPrimitiveList().getDataId();
+  Ids.Crease = getDataId(gdp()->findVertexAttribute("creaseweight"));
+  Ids.Corner = getDataId(gdp()->findPointAttribute("cornerweight"));
+  Ids.Hole = getDataId(gdp()->findPrimitiveAttribute("subdivision_hole"));
+  return Ids;
+}
 
-  // find a corresponding subd patch of the given parametric value
-  for (int x = 0; x < FaceIndices.entries(); x++) {
-    GT_Size OsdFace;
-    fpreal OsdU, OsdV;
+bool IsolineMaker::hasTopologyChanged() {
+  const TopologyIds Ids = getTopologyIds();
 
-    Osd.limitLookupPatch(FaceIndices[x], U[x], V[x], OsdFace, OsdU, OsdV,
-                         Attribute);
+  // data ids are unique across details, so a copy of the detail that kept
+  // its ids, as cooked under a preserve request, still matches
+  if (Evaluator && Ids.isValid() && Ids == CachedTopologyIds) {
+    TopologyHash = CachedTopologyHash;
+    HashedTopologyIds = Ids;
+    return false;
+  }
 
-    FaceIndices[x] = OsdFace;
-    U[x] = OsdU;
-    V[x] = OsdV;
+  // the hash is kept with the ids it was computed for, a job asks several
+  // times before the new topology is cached
+  if (!Ids.isValid() || !(Ids == HashedTopologyIds)) {
+    TopologyHash = IsolineFingerprint::hashTopology(gdp());
+    HashedTopologyIds = Ids;
   }
 
-  Surface =
-      Osd.limitSurface("P", false, FaceIndices.entries(),
-                       FaceIndices.getArray(), U.getArray(), V.getArray());
+  // new ids with the same content, as from a no-op recook upstream, adopt
+  // the ids and keep the cache
+  if (!Evaluator || TopologyHash != CachedTopologyHash)
+    return true;
 
-  LimitNormals =
-      Osd.limitSurface("N", false, FaceIndices.entries(),
-                       FaceIndices.getArray(), U.getArray(), V.getArray());
+  CachedTopologyIds = Ids;
+  return false;
 }
 
-void IsolineMaker::applyLimitSurfacePositions() {
-  for (int x = 0; x < ReferenceIndices.entries(); ++x) {
-    int PointIndex = ReferenceIndices[x];
+bool IsolineMaker::hashContent() {
+  if (!isValidGeo())
+    return false;
+  // both keep the hash of the current ids in TopologyHash and PositionHash
+  hasTopologyChanged();
+  getPositionId();
+  return true;
+}
 
-    UT_Vector3 Position = UT_Vector3(Surface->getF32(PointIndex, 0),
-                                     Surface->getF32(PointIndex, 1),
-                                     Surface->getF32(PointIndex, 2));
-    if (UsesTransform)
-      Position *= Transform;
-
-    UT_Vector3 NormalDirection =
-        UT_Vector3(LimitNormals->getF32(PointIndex, 0),
-                   LimitNormals->getF32(PointIndex, 1),
-                   LimitNormals->getF32(PointIndex, 2));
-    NormalDirection.normalize();
-    UT_Vector3 LimitSurfacePosition =
-        Position + NormalDirection * getPeakProportional();
-
-    Normals.append(NormalDirection);
-    Positions[x] = LimitSurfacePosition;
+GA_DataId IsolineMaker::getPositionId() {
+  const GA_DataId DataId = gdp()->getP()->getDataId();
+  if (DataId != GA_INVALID_DATAID && DataId == HashedPositionDataId)
+    return PositionKey;
+
+  // positions are identified by content, a data id only saves the hash
+  const uint64 Hash = IsolineFingerprint::hashPositions(gdp());
+  if (PositionKey == GA_INVALID_DATAID || Hash != PositionHash) {
+    PositionHash = Hash;
+    PositionKey++;
+  }
+  HashedPositionDataId = DataId;
+  return PositionKey;
+}
+
+void IsolineMaker::updateTopology() {
+  Topology.build(gdp());
+  HasCrease = Topology.hasCrease();
+
+  // the patches are only built once no cache file covers the content
+  if (!Evaluator)
+    Evaluator.reset(new IsolineLimitEvaluator);
+  HasEvaluatorTopology = false;
+  PatchPointsPositionId = GA_INVALID_DATAID;
+  CachedSubdivisionLevel = -1;
+
+  CachedTopologyIds = getTopologyIds();
+  CachedTopologyHash = TopologyHash;
+}
+
+void IsolineMaker::updateSubdivisionLevel() {
+  // an adaptive layout has no fixed sample count per edge to map from
+  const int PreviousLevel = CachedAdaptive ? -1 : CachedSubdivisionLevel;
+  const bool HasLimits = PreviousLevel >= 0 &&
+                         PositionId == CachedPositionId &&
+                         PositionId == PatchPointsPositionId;
+  CachedPositionId = GA_INVALID_DATAID;
+
+  fillAttributeArrays();
+
+  if (PreviousLevel < 0) {
+    Evaluator->setupSamples(FaceIndices, U, V);
+    return;
+  }
+
+  // samples sit at (i + 1) / 2^level along their edge, so the samples of a
+  // level are a subset of the ones of any higher level
+  const int PointCount = Topology.pointCount();
+  const exint EdgeCount = Topology.edgeCount();
+  const int PreviousInEdge = int(pow(2, PreviousLevel)) - 1;
+  const int InEdge = int(pow(2, SubdivisionLevel)) - 1;
+  const bool IsRefining = SubdivisionLevel > PreviousLevel;
+  const int Step = 1 << SYSabs(SubdivisionLevel - PreviousLevel);
+
+  UT_Array<exint> Sources;
+  Sources.setSizeNoInit(FaceIndices.entries());
+  for (int x = 0; x < PointCount; ++x)
+    Sources[x] = x;
+
+  UTparallelFor(
+      UT_BlockedRange<exint>(0, EdgeCount),
+      [&](const UT_BlockedRange<exint> &Range) {
+        for (exint EdgeIndex = Range.begin(); EdgeIndex != Range.end();
+             ++EdgeIndex) {
+          const exint FirstSample = PointCount + EdgeIndex * InEdge;
+          const exint PreviousFirst = PointCount + EdgeIndex * PreviousInEdge;
+          for (int PointId = 0; PointId < InEdge; ++PointId) {
+            exint &Source = Sources[FirstSample + PointId];
+            if (!IsRefining)
+              Source = PreviousFirst + (PointId + 1) * Step - 1;
+            else if ((PointId + 1) % Step == 0)
+              Source = PreviousFirst + (PointId + 1) / Step - 1;
+            else
+              Source = -1;
+          }
+        }
+      });
+
+  Evaluator->remapSamples(Sources, FaceIndices, U, V);
+
+  if (!HasLimits)
+    return;
+
+  // carry the evaluated samples over, only new midpoints are evaluated
+  UT_Vector3FArray NewPositions, NewNormals;
+  NewPositions.setSizeNoInit(Sources.entries());
+  NewNormals.setSizeNoInit(Sources.entries());
+  UT_Array<exint> NewSamples;
+  for (exint x = 0; x < Sources.entries(); ++x) {
+    if (Sources[x] < 0) {
+      NewSamples.append(x);
+      continue;
+    }
+    NewPositions[x] = LimitPositions[Sources[x]];
+    NewNormals[x] = LimitNormals[Sources[x]];
+  }
+  Evaluator->evaluateSamples(PatchPoints, NewSamples, NewPositions,
+                             NewNormals);
+
+  LimitPositions.swap(NewPositions);
+  LimitNormals.swap(NewNormals);
+  CachedPositionId = PositionId;
+}
+
+void IsolineMaker::getLimitSurfacePositions() {
+  // stencils are only built once a layout gets evaluated a second time, so
+  // static meshes and passing levels never pay for them, every deformation
+  // after that is a sparse product over the control points
+  const bool IsDeforming = Evaluator->hasSampleStencils() ||
+                           EvaluatedLayoutVersion == LayoutVersion;
+  EvaluatedLayoutVersion = LayoutVersion;
+  if (UseStencils && Tolerance <= 0.0f && IsDeforming &&
+      !Evaluator->hasSampleStencils())
+    Evaluator->setupSampleStencils();
+  // a topology the refiner rejected has no patches to build stencils from,
+  // the patch path writes its samples at the origin
+  if (UseStencils && Tolerance <= 0.0f && Evaluator->hasSampleStencils()) {
+    UT_Vector3FArray ControlPositions;
+    getControlPositions(ControlPositions);
+    Evaluator->evaluateStencils(ControlPositions, LimitPositions,
+                                LimitNormals);
+    return;
   }
+
+  updatePatchPoints();
+  Evaluator->evaluate(PatchPoints, LimitPositions, LimitNormals);
+}
+
+void IsolineMaker::getControlPositions(UT_Vector3FArray &ControlPositions) {
+  const int PointCount = Topology.pointCount();
+  ControlPositions.setSizeNoInit(PointCount);
+  for (GA_Index PointIndex = 0; PointIndex < PointCount; ++PointIndex)
+    ControlPositions[PointIndex] =
+        gdp()->getPos3(gdp()->pointOffset(PointIndex));
+}
+
+void IsolineMaker::updatePatchPoints() {
+  UT_Vector3FArray ControlPositions;
+  getControlPositions(ControlPositions);
+  Evaluator->updateControlPoints(ControlPositions, PatchPoints);
+  PatchPointsPositionId = PositionId;
+}
+
+void IsolineMaker::applyLimitSurfacePositions() {
+  // limit normals come out of the evaluator normalized
+  const float PeakOffset = Peak * BboxScale;
+  const UT_Matrix4F SampleTransform(Transform);
+
+  Positions.setSizeNoInit(LimitPositions.entries());
+  Normals = LimitNormals;
+  UTparallelForLightItems(
+      UT_BlockedRange<exint>(0, LimitPositions.entries()),
+      [&](const UT_BlockedRange<exint> &Range) {
+        for (exint x = Range.begin(); x != Range.end(); ++x) {
+          UT_Vector3 Position = LimitPositions[x];
+          if (UsesTransform)
+            Position *= SampleTransform;
+          Positions[x] = Position + LimitNormals[x] * PeakOffset;
+        }
+      });
 }
 
 void IsolineMaker::fillAttributeArrays() {
-  UT_Array<GA_OffsetArray> AllPointNeighbours;
-  gdp()->buildRingZeroPoints(AllPointNeighbours, NULL);
-
-  const GA_Attribute *CreaseAttribute =
-      gdp()->findVertexAttribute("creaseweight");
-  HasCrease = GA_ROHandleF(CreaseAttribute).isValid();
-
-  int CurrentPoint = 0;
-  float OverallCreaseValue = 0.0f;
-
-  for (GA_Iterator It(gdp()->getPointRange()); !It.atEnd(); ++It) {
-    const GA_Offset PointOffset = *It;
-    const GA_Index PointIndex = gdp()->pointIndex(PointOffset);
-
-    GA_OffsetArray Neighbours;
-    Neighbours = AllPointNeighbours[PointIndex];
-
-    for (int x = 0; x < Neighbours.entries(); x++) {
-      GA_Index NeighbourIndex = gdp()->pointIndex(Neighbours[x]);
-      if (PointIndex > NeighbourIndex) {
-        // keep point edge as indices
-        GA_Offset PointEdge[2] = {Neighbours[x], PointOffset};
-
-        GA_OffsetArray AdjacentPrimitives;
-        GeometryUtilities::adjacentPrimitivesToEdge(gdp(), AdjacentPrimitives,
-                                                    PointEdge[0], PointEdge[1]);
-        float CreaseValue = 0.0f;
-
-        GA_Offset StartPrimitive, AdjacentPrimitive;
-        StartPrimitive = AdjacentPrimitives[0];
-        if (AdjacentPrimitives.entries() > 1) {
-          AdjacentPrimitive = AdjacentPrimitives[1];
-
-          if (HasCrease)
-            CreaseValue = GeometryUtilities::getCreaseValue(
-                gdp(), StartPrimitive, AdjacentPrimitive, PointEdge[0],
-                PointEdge[1]);
-          OverallCreaseValue += CreaseValue;
+  // one sample per point shared by all its edges, followed by the inner
+  // samples of every edge, so the layout is known up front and each edge
+  // writes into its own slots
+  const int InEdgePointsCount = int(pow(2, SubdivisionLevel)) - 1;
+  const int PointCount = Topology.pointCount();
+  const exint EdgeCount = Topology.edgeCount();
+  const exint SampleCount = PointCount + EdgeCount * InEdgePointsCount;
+
+  EdgeSampleOffsets.setSizeNoInit(EdgeCount + 1);
+  for (exint x = 0; x <= EdgeCount; ++x)
+    EdgeSampleOffsets[x] = x * InEdgePointsCount;
+
+  FaceIndices.setSizeNoInit(SampleCount);
+  U.setSizeNoInit(SampleCount);
+  V.setSizeNoInit(SampleCount);
+  fillCornerSamples();
+
+  UTparallelFor(
+      UT_BlockedRange<exint>(0, EdgeCount),
+      [&](const UT_BlockedRange<exint> &Range) {
+        for (exint EdgeIndex = Range.begin(); EdgeIndex != Range.end();
+             ++EdgeIndex) {
+          const exint FirstSample = edgeFirstSample(EdgeIndex);
+          for (int PointId = 0; PointId < InEdgePointsCount; PointId++) {
+            float Factor = float(PointId + 1) / float(InEdgePointsCount + 1);
+            setEdgeSample(EdgeIndex, Factor, FirstSample + PointId);
+          }
         }
+      });
+
+  fillStripIndices();
+}
+
+void IsolineMaker::fillAdaptiveAttributeArrays() {
+  const int PointCount = Topology.pointCount();
+  const exint EdgeCount = Topology.edgeCount();
+
+  CachedPositionId = GA_INVALID_DATAID;
+  updatePatchPoints();
+  BboxScale = getBboxScale();
+  // relative to the largest side, the volume scale vanishes for flat meshes
+  UT_BoundingBox Bbox;
+  gdp()->getBBox(&Bbox);
+  const float MaxDeviation = Tolerance * Bbox.sizeMax();
+
+  FaceIndices.setSizeNoInit(PointCount);
+  U.setSizeNoInit(PointCount);
+  V.setSizeNoInit(PointCount);
+  fillCornerSamples();
+
+  UT_Vector3FArray CornerPositions, CornerNormals;
+  CornerPositions.setSizeNoInit(PointCount);
+  CornerNormals.setSizeNoInit(PointCount);
+  UTparallelFor(
+      UT_BlockedRange<int>(0, PointCount),
+      [&](const UT_BlockedRange<int> &Range) {
+        for (int x = Range.begin(); x != Range.end(); ++x)
+          Evaluator->evaluatePoint(PatchPoints, FaceIndices[x], U[x], V[x],
+                                   CornerPositions[x], CornerNormals[x]);
+      });
+
+  // bisects every edge while the limit curve strays from the chord by more
+  // than the tolerance, down to the subdivision level at most
+  struct EdgeSamples {
+    UT_Array<float> Factors;
+    UT_Vector3FArray Positions, Normals;
+  };
+  UT_Array<EdgeSamples> Samples;
+  Samples.setSize(EdgeCount);
+
+  UTparallelFor(
+      UT_BlockedRange<exint>(0, EdgeCount),
+      [&](const UT_BlockedRange<exint> &Range) {
+        for (exint EdgeIndex = Range.begin(); EdgeIndex != Range.end();
+             ++EdgeIndex) {
+          const IsolineTopology::Edge &Edge = Topology.edge(EdgeIndex);
+          const int FaceIndex = Edge.Faces[0];
+          const int FaceSize = Topology.faceSize(FaceIndex);
+          EdgeSamples &Found = Samples[EdgeIndex];
 
-        // patametric coordinates
-        int FaceIndex = gdp()->primitiveIndex(StartPrimitive);
-        UT_Vector3 Uv0, Uv1;
-        GeometryUtilities::getOsdParametricValues(
-            gdp(), StartPrimitive, PointEdge[0], PointEdge[1], Uv0, Uv1);
-
-        CreaseValue = SYSfit(CreaseValue, 0.0f, 4.0f, 0.0f, 1.0f);
-        UT_Vector3 CdValue = SYSlerp(UT_Vector3(0.0, 0.9, 0.9),
-                                     UT_Vector3(1.0, 0.0, 0.0), CreaseValue);
-
-        ReferenceIndices.append(CurrentPoint);
-        FaceIndices.append(FaceIndex);
-        U.append(Uv0.x());
-        V.append(Uv0.y());
-        CurrentPoint++;
-
-        // points inbetween
-        int InEdgePointsCount = int(pow(2, SubdivisionLevel)) - 1;
-        for (int PointId = 0; PointId < InEdgePointsCount; PointId++) {
-          float Factor = float(PointId + 1) / float(InEdgePointsCount + 1);
-          UT_Vector3 Uvi = Uv0 + (Uv1 - Uv0) * Factor;
-
-          ReferenceIndices.append(CurrentPoint);
-          ReferenceIndices.append(CurrentPoint);
-          FaceIndices.append(FaceIndex);
-          U.append(Uvi.x());
-          V.append(Uvi.y());
-          CurrentPoint++;
+          auto evaluate = [&](float Factor, UT_Vector3F &Position,
+                              UT_Vector3F &Normal) {
+            int SubFace;
+            float S, T;
+            GeometryUtilities::getOsdPatchCoordinates(
+                FaceSize, Edge.Slots[0], Edge.Slots[1], Factor, SubFace, S,
+                T);
+            Evaluator->evaluatePoint(
+                PatchPoints, Topology.facePtexIndex(FaceIndex) + SubFace, S,
+                T, Position, Normal);
+          };
+          // distance of the curve at Weight between the ends to the chord
+          auto deviation = [&](float Factor0, const UT_Vector3F &Position0,
+                               float Factor1, const UT_Vector3F &Position1,
+                               float Weight) {
+            UT_Vector3F Position, Normal;
+            evaluate(SYSlerp(Factor0, Factor1, Weight), Position, Normal);
+            return (Position - Position0 - (Position1 - Position0) * Weight)
+                .length();
+          };
+
+          std::function<void(float, const UT_Vector3F &, float,
+                             const UT_Vector3F &, int)>
+              bisect = [&](float Factor0, const UT_Vector3F &Position0,
+                           float Factor1, const UT_Vector3F &Position1,
+                           int Depth) {
+                if (Depth >= SubdivisionLevel)
+                  return;
+
+                const float Factor = (Factor0 + Factor1) * 0.5f;
+                UT_Vector3F Position, Normal;
+                evaluate(Factor, Position, Normal);
+
+                // the edge midpoint is always kept, every segment needs an
+                // inner sample to take its crease from, an s-shaped curve
+                // crosses the chord at the midpoint but not at the quarters
+                const UT_Vector3F Chord = (Position0 + Position1) * 0.5f;
+                if (Depth > 0 && (Position - Chord).length() <= MaxDeviation &&
+                    deviation(Factor0, Position0, Factor1, Position1,
+                              0.25f) <= MaxDeviation &&
+                    deviation(Factor0, Position0, Factor1, Position1,
+                              0.75f) <= MaxDeviation)
+                  return;
+
+                bisect(Factor0, Position0, Factor, Position, Depth + 1);
+                Found.Factors.append(Factor);
+                Found.Positions.append(Position);
+                Found.Normals.append(Normal);
+                bisect(Factor, Position, Factor1, Position1, Depth + 1);
+              };
+          bisect(0.0f, CornerPositions[Edge.Points[0]], 1.0f,
+                 CornerPositions[Edge.Points[1]], 0);
         }
+      });
 
-        ReferenceIndices.append(CurrentPoint);
+  EdgeSampleOffsets.setSizeNoInit(EdgeCount + 1);
+  EdgeSampleOffsets[0] = 0;
+  for (exint x = 0; x < EdgeCount; ++x)
+    EdgeSampleOffsets[x + 1] =
+        EdgeSampleOffsets[x] + Samples[x].Factors.entries();
 
-        FaceIndices.append(FaceIndex);
-        U.append(Uv1.x());
-        V.append(Uv1.y());
-        CurrentPoint++;
+  const exint SampleCount = PointCount + EdgeSampleOffsets[EdgeCount];
+  FaceIndices.setSizeNoInit(SampleCount);
+  U.setSizeNoInit(SampleCount);
+  V.setSizeNoInit(SampleCount);
+  LimitPositions.setSizeNoInit(SampleCount);
+  LimitNormals.setSizeNoInit(SampleCount);
+  for (int x = 0; x < PointCount; ++x) {
+    LimitPositions[x] = CornerPositions[x];
+    LimitNormals[x] = CornerNormals[x];
+  }
 
-        // append point block of inEdgePointsCount + 2 points
-        // create polyline out of them
-        // set color attr to points remapped from creasevalue
-        int NumberOfPoints = InEdgePointsCount * 2 + 2;
-        // int num_points = lineCount;
-        Positions.appendMultiple(CdValue, NumberOfPoints);
-        Colors.appendMultiple(CdValue, NumberOfPoints);
-      }
+  UTparallelFor(
+      UT_BlockedRange<exint>(0, EdgeCount),
+      [&](const UT_BlockedRange<exint> &Range) {
+        for (exint EdgeIndex = Range.begin(); EdgeIndex != Range.end();
+             ++EdgeIndex) {
+          const EdgeSamples &Found = Samples[EdgeIndex];
+          const exint FirstSample = edgeFirstSample(EdgeIndex);
+          for (exint x = 0; x < Found.Factors.entries(); ++x) {
+            setEdgeSample(EdgeIndex, Found.Factors[x], FirstSample + x);
+            LimitPositions[FirstSample + x] = Found.Positions[x];
+            LimitNormals[FirstSample + x] = Found.Normals[x];
+          }
+        }
+      });
+
+  fillStripIndices();
+  Evaluator->setupSamples(FaceIndices, U, V);
+  CachedPositionId = PositionId;
+}
+
+void IsolineMaker::fillCornerSamples() {
+  // corner samples, taken at the point's corner of any face using it
+  UTparallelFor(
+      UT_BlockedRange<int>(0, Topology.pointCount()),
+      [&](const UT_BlockedRange<int> &Range) {
+        for (int PointIndex = Range.begin(); PointIndex != Range.end();
+             ++PointIndex) {
+          const int FaceIndex = Topology.pointFace(PointIndex);
+          if (FaceIndex < 0) {
+            FaceIndices[PointIndex] = -1;
+            U[PointIndex] = V[PointIndex] = 0.0f;
+            continue;
+          }
+          const int FaceSize = Topology.faceSize(FaceIndex);
+          const int Slot = Topology.pointSlot(PointIndex);
+          int SubFace;
+          GeometryUtilities::getOsdPatchCoordinates(
+              FaceSize, Slot, (Slot + 1) % FaceSize, 0.0f, SubFace,
+              U[PointIndex], V[PointIndex]);
+          FaceIndices[PointIndex] = Topology.facePtexIndex(FaceIndex) + SubFace;
+        }
+      });
+}
+
+void IsolineMaker::setEdgeSample(exint EdgeIndex, float Factor,
+                                 exint Sample) {
+  // ptex coordinates along the edge in Faces[0]
+  const IsolineTopology::Edge &Edge = Topology.edge(EdgeIndex);
+  const int FaceIndex = Edge.Faces[0];
+  int SubFace;
+  GeometryUtilities::getOsdPatchCoordinates(
+      Topology.faceSize(FaceIndex), Edge.Slots[0], Edge.Slots[1], Factor,
+      SubFace, U[Sample], V[Sample]);
+  FaceIndices[Sample] = Topology.facePtexIndex(FaceIndex) + SubFace;
+}
+
+void IsolineMaker::fillStripIndices() {
+  const exint EdgeCount = Topology.edgeCount();
+  StripIndices.setSizeNoInit(edgeFirstIndex(EdgeCount));
+  EdgeCreases.setSizeNoInit(EdgeCount);
+
+  UTparallelFor(
+      UT_BlockedRange<exint>(0, EdgeCount),
+      [&](const UT_BlockedRange<exint> &Range) {
+        for (exint EdgeIndex = Range.begin(); EdgeIndex != Range.end();
+             ++EdgeIndex) {
+          const IsolineTopology::Edge &Edge = Topology.edge(EdgeIndex);
+          EdgeCreases[EdgeIndex] = HasCrease ? Edge.Crease : 0.0f;
+
+          // strip from the first point through the inner samples to the
+          // second point
+          const exint FirstSample = edgeFirstSample(EdgeIndex);
+          const int InEdgePointsCount = edgeSampleCount(EdgeIndex);
+          exint Index = edgeFirstIndex(EdgeIndex);
+          StripIndices[Index++] = Edge.Points[0];
+          for (int PointId = 0; PointId < InEdgePointsCount; PointId++)
+            StripIndices[Index++] = FirstSample + PointId;
+          StripIndices[Index++] = Edge.Points[1];
+          StripIndices[Index] = StripRestartIndex;
+        }
+      });
+}
+
+void IsolineMaker::createGeometry(GU_Detail *TargetGdp) {
+  OutputSamples.clear();
+  if (ChainEdges)
+    createChainedGeometry(TargetGdp);
+  else
+    createEdgeGeometry(TargetGdp);
+
+  // everything is new, remember the ids so the next cook can tell whether
+  // the output still holds this layout
+  TargetGdp->bumpAllDataIds();
+  OutputLayoutVersion = LayoutVersion;
+  OutputChainEdges = ChainEdges;
+  OutputTopologyId = TargetGdp->getTopology().getDataId();
+  OutputPrimitiveListId = TargetGdp->getPrimitiveList().getDataId();
+}
+
+bool IsolineMaker::updateGeometry(GU_Detail *TargetGdp) {
+  if (LayoutVersion != OutputLayoutVersion || ChainEdges != OutputChainEdges)
+    return false;
+
+  // another detail, or one modified since createGeometry, has other ids
+  const GA_DataId TopologyId = TargetGdp->getTopology().getDataId();
+  const GA_DataId PrimitiveListId = TargetGdp->getPrimitiveList().getDataId();
+  if (TopologyId == GA_INVALID_DATAID || TopologyId != OutputTopologyId ||
+      PrimitiveListId != OutputPrimitiveListId ||
+      TargetGdp->getNumPoints() != OutputSamples.entries())
+    return false;
+
+  writePositions(TargetGdp);
+  TargetGdp->getP()->bumpDataId();
+  return true;
+}
+
+void IsolineMaker::createEdgeGeometry(GU_Detail *TargetGdp) {
+  // every strip but its restart index becomes a polyline
+  const exint PolylineCount = Topology.edgeCount();
+  const exint PointCount = edgeFirstIndex(PolylineCount) - PolylineCount;
+
+  if (PolylineCount == 0)
+    return;
+
+  // all points in one block, all polylines in one batch over it
+  const GA_Offset StartOffset = TargetGdp->appendPointBlock(PointCount);
+
+  UT_Array<int> PolylinePoints;
+  PolylinePoints.setSizeNoInit(PointCount);
+  for (exint x = 0; x < PointCount; ++x)
+    PolylinePoints[x] = x;
+
+  // the polylines only differ in the samples their points come from
+  GEO_PolyCounts PolylineSizes;
+  UT_Array<int> PointEdges;
+  OutputSamples.setSizeNoInit(PointCount);
+  PointEdges.setSizeNoInit(PointCount);
+  for (exint EdgeIndex = 0, Point = 0; EdgeIndex < PolylineCount;
+       ++EdgeIndex) {
+    const int PointsPerPolyline = edgeSampleCount(EdgeIndex) + 2;
+    const exint FirstIndex = edgeFirstIndex(EdgeIndex);
+    PolylineSizes.append(PointsPerPolyline);
+    for (int x = 0; x < PointsPerPolyline; ++x, ++Point) {
+      OutputSamples[Point] = StripIndices[FirstIndex + x];
+      PointEdges[Point] = EdgeIndex;
     }
   }
+  GEO_PrimPoly::buildBlock(TargetGdp, StartOffset, PointCount, PolylineSizes,
+                           PolylinePoints.getArray(), false);
 
-  if (OverallCreaseValue < 0.01f)
-    HasCrease = false;
+  OutputStartOffset = StartOffset;
+  writePositions(TargetGdp);
+
+  GA_RWHandleV3 ColorHandle(
+      TargetGdp->addFloatTuple(GA_ATTRIB_POINT, GA_SCOPE_PUBLIC, "Cd", 3));
+  const GA_Range PointRange(TargetGdp->getPointMap(), StartOffset,
+                            StartOffset + PointCount);
+  UTparallelForLightItems(
+      GA_SplittableRange(PointRange), [&](const GA_SplittableRange &Range) {
+        GA_Offset Start, End;
+        for (GA_Iterator It(Range); It.blockAdvance(Start, End);) {
+          for (GA_Offset Offset = Start; Offset < End; ++Offset) {
+            const int EdgeIndex = PointEdges[Offset - StartOffset];
+            ColorHandle.set(Offset, GeometryUtilities::getCreaseColor(
+                                        EdgeCreases[EdgeIndex]));
+          }
+        }
+      });
 }
 
-void IsolineMaker::createGeometry(GU_Detail *TargetGdp) {
-  TargetGdp->addFloatTuple(GA_ATTRIB_POINT, GA_SCOPE_PUBLIC, "Cd", 3);
-  // MAGIC
-  int PointsPerPolyline = (int(pow(2, SubdivisionLevel)) - 1) * 2 + 2;
-  int PolylineCount = Positions.size() / PointsPerPolyline;
+void IsolineMaker::findEdgeLinks(UT_Array<int> &Links) {
+  const int PointCount = Topology.pointCount();
+  const exint EdgeCount = Topology.edgeCount();
+
+  // edges around every point
+  UT_Array<int> PointEdgeOffsets, PointEdges;
+  PointEdgeOffsets.appendMultiple(0, PointCount + 1);
+  for (exint x = 0; x < EdgeCount; ++x) {
+    PointEdgeOffsets[Topology.edge(x).Points[0] + 1]++;
+    PointEdgeOffsets[Topology.edge(x).Points[1] + 1]++;
+  }
+  for (int x = 0; x < PointCount; ++x)
+    PointEdgeOffsets[x + 1] += PointEdgeOffsets[x];
+
+  UT_Array<int> Cursors(PointEdgeOffsets);
+  PointEdges.setSizeNoInit(EdgeCount * 2);
+  for (exint x = 0; x < EdgeCount; ++x) {
+    PointEdges[Cursors[Topology.edge(x).Points[0]]++] = x;
+    PointEdges[Cursors[Topology.edge(x).Points[1]]++] = x;
+  }
+
+  auto shareFace = [&](const IsolineTopology::Edge &A,
+                       const IsolineTopology::Edge &B) {
+    return A.Faces[0] == B.Faces[0] || A.Faces[0] == B.Faces[1] ||
+           A.Faces[1] == B.Faces[0] || A.Faces[1] == B.Faces[1];
+  };
+
+  // Links[2 * Edge + Side] is the edge continuing past Points[Side], or -1
+  Links.clear();
+  Links.appendMultiple(-1, EdgeCount * 2);
+
+  UTparallelFor(
+      UT_BlockedRange<int>(0, PointCount),
+      [&](const UT_BlockedRange<int> &Range) {
+        for (int Point = Range.begin(); Point != Range.end(); ++Point) {
+          const int First = PointEdgeOffsets[Point];
+          if (PointEdgeOffsets[Point + 1] - First != 4)
+            continue;
+
+          // interior points only, boundary edges have a single face
+          bool IsRegular = true;
+          for (int x = 0; x < 4; ++x)
+            IsRegular &= Topology.edge(PointEdges[First + x]).Faces[1] >= 0;
+          if (!IsRegular)
+            continue;
+
+          // the edge across shares no face, chains keep a single crease
+          for (int x = 0; x < 4; ++x) {
+            const int EdgeIndex = PointEdges[First + x];
+            const IsolineTopology::Edge &Edge = Topology.edge(EdgeIndex);
+            for (int y = 0; y < 4; ++y) {
+              const int OtherIndex = PointEdges[First + y];
+              const IsolineTopology::Edge &Other = Topology.edge(OtherIndex);
+              if (y == x || shareFace(Edge, Other) ||
+                  !GeometryUtilities::almostEqual(EdgeCreases[EdgeIndex],
+                                                  EdgeCreases[OtherIndex]))
+                continue;
+              Links[EdgeIndex * 2 + (Edge.Points[0] == Point ? 0 : 1)] =
+                  OtherIndex;
+            }
+          }
+        }
+      });
+
+  // non-manifold fans can pick an edge that doesn't pick back, only mutual
+  // links are kept so every chain is a simple strip or loop
+  UT_Array<int> MutualLinks(Links);
+  for (exint x = 0; x < EdgeCount * 2; ++x) {
+    const int OtherIndex = Links[x];
+    if (OtherIndex < 0)
+      continue;
+    const int Point = Topology.edge(x / 2).Points[x % 2];
+    const IsolineTopology::Edge &Other = Topology.edge(OtherIndex);
+    if (Links[OtherIndex * 2 + (Other.Points[0] == Point ? 0 : 1)] != x / 2)
+      MutualLinks[x] = -1;
+  }
+  Links = MutualLinks;
+}
+
+void IsolineMaker::createChainedGeometry(GU_Detail *TargetGdp) {
+  const exint EdgeCount = Topology.edgeCount();
 
-  for (int x = 0; x < PolylineCount; x++) {
-    GA_Offset appendOffset = TargetGdp->appendPointBlock(PointsPerPolyline);
+  if (EdgeCount == 0)
+    return;
 
-    GA_Attribute *Cd = TargetGdp->findPointAttribute("Cd");
-    const GA_AIFTuple *tuple = Cd->getAIFTuple();
+  UT_Array<int> Links;
+  findEdgeLinks(Links);
 
-    for (exint PointId = 0; PointId < PointsPerPolyline; ++PointId) {
-      int Index = x * PointsPerPolyline + PointId;
+  // walks edge by edge, Forward runs from Points[0] to Points[1]
+  auto endPoint = [&](int EdgeIndex, bool Forward) {
+    return Topology.edge(EdgeIndex).Points[Forward ? 1 : 0];
+  };
+  auto nextEdge = [&](int &EdgeIndex, bool &Forward) {
+    const int Point = endPoint(EdgeIndex, Forward);
+    EdgeIndex = Links[EdgeIndex * 2 + (Forward ? 1 : 0)];
+    if (EdgeIndex >= 0)
+      Forward = Topology.edge(EdgeIndex).Points[0] == Point;
+  };
 
-      GA_Offset ptoff = appendOffset + PointId;
-      UT_Vector3 CdValue = Colors[Index];
-      tuple->set(Cd, ptoff, CdValue.data(), 3);
-      TargetGdp->setPos3(ptoff, Positions[Index]);
+  // output points are welded samples, a sample keeps its point once used
+  UT_Array<int> SamplePoints;
+  SamplePoints.appendMultiple(-1, Positions.entries());
+  UT_Array<int> PointSamples;
+  auto usePoint = [&](int Sample) {
+    if (SamplePoints[Sample] < 0) {
+      SamplePoints[Sample] = PointSamples.entries();
+      PointSamples.append(Sample);
     }
+    return SamplePoints[Sample];
+  };
+
+  // open strips and closed loops go into separate batches
+  UT_Array<int> OpenPoints, ClosedPoints;
+  UT_Array<int> OpenSizes, ClosedSizes;
+  UT_Array<int> OpenEdges, ClosedEdges;
+  UT_Array<bool> Visited;
+  Visited.appendMultiple(false, EdgeCount);
+
+  for (int EdgeIndex = 0; EdgeIndex < EdgeCount; ++EdgeIndex) {
+    if (Visited[EdgeIndex])
+      continue;
 
-    GEO_PrimPoly *PrimPolyPtr =
-        (GEO_PrimPoly *)TargetGdp->appendPrimitive(GA_PRIMPOLY);
-    PrimPolyPtr->setSize(0);
-    for (exint PointId = 0; PointId < PointsPerPolyline; ++PointId)
-      PrimPolyPtr->appendVertex(appendOffset + PointId);
+    // back up to the start of the strip, or find that it is a loop,
+    // Backward is the direction the start edge is left by when backing up
+    int Start = EdgeIndex;
+    bool Backward = false;
+    bool IsClosed = false;
+    for (;;) {
+      int Previous = Start;
+      bool PreviousBackward = Backward;
+      nextEdge(Previous, PreviousBackward);
+      if (Previous < 0)
+        break;
+      if (Previous == EdgeIndex) {
+        IsClosed = true;
+        break;
+      }
+      Start = Previous;
+      Backward = PreviousBackward;
+    }
+    if (IsClosed) {
+      Start = EdgeIndex;
+      Backward = false;
+    }
+
+    UT_Array<int> &ChainPoints = IsClosed ? ClosedPoints : OpenPoints;
+    const exint FirstPoint = ChainPoints.entries();
+    int Current = Start;
+    bool Forward = !Backward;
+    ChainPoints.append(usePoint(endPoint(Current, !Forward)));
+    do {
+      Visited[Current] = true;
+      const exint FirstSample = edgeFirstSample(Current);
+      const int InEdgePointsCount = edgeSampleCount(Current);
+      for (int PointId = 0; PointId < InEdgePointsCount; ++PointId)
+        ChainPoints.append(usePoint(
+            FirstSample +
+            (Forward ? PointId : InEdgePointsCount - 1 - PointId)));
+      ChainPoints.append(usePoint(endPoint(Current, Forward)));
+      nextEdge(Current, Forward);
+    } while (Current >= 0 && Current != Start);
+
+    // a loop ends where it started
+    if (IsClosed)
+      ChainPoints.removeLast();
+
+    (IsClosed ? ClosedSizes : OpenSizes)
+        .append(ChainPoints.entries() - FirstPoint);
+    (IsClosed ? ClosedEdges : OpenEdges).append(Start);
   }
+
+  const GA_Offset StartOffset =
+      TargetGdp->appendPointBlock(PointSamples.entries());
+
+  GEO_PolyCounts OpenCounts, ClosedCounts;
+  for (exint x = 0; x < OpenSizes.entries(); ++x)
+    OpenCounts.append(OpenSizes[x]);
+  for (exint x = 0; x < ClosedSizes.entries(); ++x)
+    ClosedCounts.append(ClosedSizes[x]);
+
+  GA_Offset OpenStart = GA_INVALID_OFFSET, ClosedStart = GA_INVALID_OFFSET;
+  if (OpenSizes.entries())
+    OpenStart = GEO_PrimPoly::buildBlock(TargetGdp, StartOffset,
+                                         PointSamples.entries(), OpenCounts,
+                                         OpenPoints.getArray(), false);
+  if (ClosedSizes.entries())
+    ClosedStart = GEO_PrimPoly::buildBlock(
+        TargetGdp, StartOffset, PointSamples.entries(), ClosedCounts,
+        ClosedPoints.getArray(), true);
+
+  // welded points sit between edges of different creases, so the crease
+  // color is kept on the primitives
+  GA_RWHandleV3 ColorHandle(
+      TargetGdp->addFloatTuple(GA_ATTRIB_PRIMITIVE, GA_SCOPE_PUBLIC, "Cd", 3));
+  for (exint x = 0; x < OpenEdges.entries(); ++x)
+    ColorHandle.set(OpenStart + x, GeometryUtilities::getCreaseColor(
+                                       EdgeCreases[OpenEdges[x]]));
+  for (exint x = 0; x < ClosedEdges.entries(); ++x)
+    ColorHandle.set(ClosedStart + x, GeometryUtilities::getCreaseColor(
+                                         EdgeCreases[ClosedEdges[x]]));
+
+  OutputSamples = PointSamples;
+  OutputStartOffset = StartOffset;
+  writePositions(TargetGdp);
 }
 
-void IsolineMaker::getAttributeArrays(UT_Vector3FArray &OutPositions,
-                                      UT_Vector3FArray &OutColors,
-                                      UT_Vector3FArray &OutNormals) {
-  OutPositions.clear();
-  OutColors.clear();
-  OutNormals.clear();
+void IsolineMaker::writePositions(GU_Detail *TargetGdp) {
+  if (OutputSamples.isEmpty())
+    return;
 
+  // the points were appended as one contiguous block
+  GA_RWHandleV3 PositionHandle(TargetGdp->getP());
+  const GA_Range PointRange(TargetGdp->getPointMap(), OutputStartOffset,
+                            OutputStartOffset + OutputSamples.entries());
+  UTparallelForLightItems(
+      GA_SplittableRange(PointRange), [&](const GA_SplittableRange &Range) {
+        GA_Offset Start, End;
+        for (GA_Iterator It(Range); It.blockAdvance(Start, End);)
+          for (GA_Offset Offset = Start; Offset < End; ++Offset)
+            PositionHandle.set(
+                Offset, Positions[OutputSamples[Offset - OutputStartOffset]]);
+      });
+}
+
+void IsolineMaker::getAttributeArrays(UT_Vector3FArray &OutPositions,
+                                      UT_Vector3FArray &OutNormals,
+                                      UT_Array<float> &OutCreases,
+                                      UT_Array<int> &OutIndices) {
   OutPositions = Positions;
-  OutColors = Colors;
   OutNormals = Normals;
+  OutIndices = StripIndices;
+  getSampleCreases(OutCreases);
+}
+
+bool IsolineMaker::hasCacheFile() {
+  // only a new topology reads a cache file, so a deforming mesh never
+  // probes, the hashes are the ones calculateAttributeArrays uses next
+  if (CacheDirectory.isEmpty() || Tolerance > 0.0f || !isValidGeo() ||
+      !hasTopologyChanged())
+    return false;
+
+  getPositionId();
+  const IsolineDiskCache::Key CacheKey = {TopologyHash, PositionHash,
+                                          SubdivisionLevel};
+  IsolineDiskCache CacheFile;
+  return CacheFile.open(IsolineDiskCache::getPath(CacheDirectory, CacheKey),
+                        CacheKey);
+}
+
+bool IsolineMaker::writeCacheFile() {
+  // only complete uniform layouts are keyed by level
+  if (CacheDirectory.isEmpty() || CachedAdaptive ||
+      CachedSubdivisionLevel < 0 || CachedPositionId != PositionId ||
+      PositionId == GA_INVALID_DATAID)
+    return false;
+
+  const IsolineDiskCache::Key CacheKey = {CachedTopologyHash, PositionHash,
+                                          CachedSubdivisionLevel};
+  return IsolineDiskCache::write(
+      IsolineDiskCache::getPath(CacheDirectory, CacheKey), CacheKey,
+      LimitPositions, LimitNormals, StripIndices);
+}
+
+bool IsolineMaker::readCacheFile() {
+  if (CacheDirectory.isEmpty())
+    return false;
+
+  const IsolineDiskCache::Key CacheKey = {CachedTopologyHash, PositionHash,
+                                          SubdivisionLevel};
+  IsolineDiskCache CacheFile;
+  if (!CacheFile.open(IsolineDiskCache::getPath(CacheDirectory, CacheKey),
+                      CacheKey))
+    return false;
+
+  // the key pins topology and level, so the file holds the uniform layout
+  // and strips fillAttributeArrays would build, the ptex coordinates are
+  // left out until the evaluator needs them
+  const int InEdgePointsCount = int(pow(2, SubdivisionLevel)) - 1;
+  const exint EdgeCount = Topology.edgeCount();
+  const exint SampleCount =
+      Topology.pointCount() + EdgeCount * InEdgePointsCount;
+  const exint IndexCount = EdgeCount * (InEdgePointsCount + 3);
+  if (CacheFile.sampleCount() != SampleCount ||
+      CacheFile.indexCount() != IndexCount)
+    return false;
+
+  EdgeSampleOffsets.setSizeNoInit(EdgeCount + 1);
+  for (exint x = 0; x <= EdgeCount; ++x)
+    EdgeSampleOffsets[x] = x * InEdgePointsCount;
+  EdgeCreases.setSizeNoInit(EdgeCount);
+  for (exint x = 0; x < EdgeCount; ++x)
+    EdgeCreases[x] = HasCrease ? Topology.edge(x).Crease : 0.0f;
+  FaceIndices.clear();
+  U.clear();
+  V.clear();
+
+  // strips and limit samples are copied straight out of the mapping
+  StripIndices.setSizeNoInit(IndexCount);
+  memcpy(StripIndices.array(), CacheFile.indices(), IndexCount * sizeof(int));
+  LimitPositions.setSizeNoInit(SampleCount);
+  LimitNormals.setSizeNoInit(SampleCount);
+  memcpy(LimitPositions.array(), CacheFile.positions(),
+         SampleCount * sizeof(UT_Vector3F));
+  memcpy(LimitNormals.array(), CacheFile.normals(),
+         SampleCount * sizeof(UT_Vector3F));
+  return true;
+}
+
+void IsolineMaker::getSampleCreases(UT_Array<float> &OutCreases) {
+  const int PointCount = Topology.pointCount();
+
+  // corner samples are shared by edges with different creases, they get a
+  // negative weight and the inner sample of each segment decides
+  OutCreases.setSizeNoInit(LimitPositions.entries());
+  for (int x = 0; x < PointCount; ++x)
+    OutCreases[x] = -1.0f;
+  for (exint EdgeIndex = 0; EdgeIndex < EdgeCreases.entries(); ++EdgeIndex) {
+    const exint FirstSample = edgeFirstSample(EdgeIndex);
+    for (int x = 0; x < edgeSampleCount(EdgeIndex); ++x)
+      OutCreases[FirstSample + x] = EdgeCreases[EdgeIndex];
+  }
+}
+
+int64 IsolineMaker::getMemoryUsage() const {
+  int64 Usage = Topology.getMemoryUsage() + Positions.getMemoryUsage() +
+                Normals.getMemoryUsage() + FaceIndices.getMemoryUsage() +
+                U.getMemoryUsage() + V.getMemoryUsage() +
+                EdgeSampleOffsets.getMemoryUsage() +
+                StripIndices.getMemoryUsage() + EdgeCreases.getMemoryUsage() +
+                LimitPositions.getMemoryUsage() +
+                LimitNormals.getMemoryUsage() + PatchPoints.getMemoryUsage() +
+                OutputSamples.getMemoryUsage();
+  if (Evaluator)
+    Usage += Evaluator->getMemoryUsage();
+  return Usage;
 }
 
 bool IsolineMaker::isValidGeo() {
@@ -263,7 +1047,14 @@ bool IsolineMaker::isValidGeo() {
   if (NormalRoHandle.isValid())
     return false;
 
-  for (GA_Iterator it(gdp()->getPrimitiveRange()); !it.atEnd(); ++it) {
+  // the primitive scan only runs again for new topology ids
+  const TopologyIds Ids = getTopologyIds();
+  if (Ids.isValid() && Ids == ValidatedTopologyIds)
+    return IsValidTopology;
+
+  bool IsValid = true;
+  for (GA_Iterator it(gdp()->getPrimitiveRange()); IsValid && !it.atEnd();
+       ++it) {
     auto PrimType = GA_PRIMPOLY;
     const GA_Size MinVertexCount = 3;
 
@@ -272,19 +1063,25 @@ bool IsolineMaker::isValidGeo() {
 
     // Skip unusual prim types like volumes
     if (CurrentPrimitive->getTypeId() != PrimType)
-      return false;
+      IsValid = false;
 
     // Won't work with polylines
     if (CurrentPrimitive->getVertexCount() < MinVertexCount)
-      return false;
+      IsValid = false;
   }
-  return true;
+  ValidatedTopologyIds = Ids;
+  IsValidTopology = IsValid;
+  return IsValid;
 }
 
 const GU_Detail *IsolineMaker::gdp() { return GdpHandle.gdp(); }
 
-float IsolineMaker::getPeakProportional() {
+bool IsolineMaker::isCancelled() const {
+  return CancelFlag && CancelFlag->load();
+}
+
+float IsolineMaker::getBboxScale() {
   UT_BoundingBox Bbox;
   gdp()->getBBox(&Bbox);
-  return Peak * cbrt(Bbox.volume());
+  return cbrt(Bbox.volume());
 }
@@ -1,48 +1,241 @@
 #pragma once
 
-#include <GT/GT_DataArray.h>
+#include "IsolineTopology.h"
+
 #include <GU/GU_Detail.h>
 #include <GU/GU_DetailHandle.h>
+#include <SYS/SYS_AtomicInt.h>
 #include <SYS/SYS_Math.h>
+#include <UT/UT_StringHolder.h>
+#include <UT/UT_UniquePtr.h>
+
+class IsolineLimitEvaluator;
 
 class IsolineMaker {
 public:
-  IsolineMaker(GU_DetailHandle GdpHandle, float Peak, int SubdivisionLevel);
-  IsolineMaker(GU_DetailHandle GdpHandle, UT_DMatrix4 Transform, float Peak,
-               int SubdivisionLevel);
+  IsolineMaker();
+  ~IsolineMaker();
+
+  // the maker is meant to live across recomputes, topology index, limit
+  // evaluator and sample table are kept until the detail topology changes
+  void setDetail(const GU_ConstDetailHandle &GdpHandle);
+  void setTransform(const UT_DMatrix4 &Transform);
+  void setPeak(float Peak);
+  void setSubdivisionLevel(int SubdivisionLevel);
+  // above 0 edges are only bisected while the limit curve strays from the
+  // chord by more than this fraction of the largest bbox side at the
+  // midpoint or the quarters, the subdivision level caps the depth
+  void setTolerance(float Tolerance);
+  // createGeometry joins edges running straight through regular points
+  // into long polylines over welded points
+  void setChainEdges(bool ChainEdges);
+  // a deforming mesh evaluates the samples through precomputed limit
+  // stencils over the control points, costs memory and a setup per sample
+  // layout, adaptive layouts always use the patches
+  void setUseStencils(bool UseStencils);
+  // directory of isoline cache files named by content hash and level, a
+  // new topology with a file skips the limit evaluator until its shape or
+  // level change, empty disables
+  void setCacheDirectory(const UT_StringHolder &CacheDirectory);
+  // calculateAttributeArrays gives up between stages once the flag is set
+  void setCancelFlag(const SYS_AtomicInt32 *CancelFlag);
+
   // function which calculates isoline positions
   bool calculateAttributeArrays();
-  // arrays for gl rendering
+  // bumped whenever calculateAttributeArrays changes the arrays, a recook
+  // to identical geometry keeps it
+  exint getArraysVersion() const { return ArraysVersion; }
+  // refreshes the content hashes of the detail, only rehashing what has
+  // new data ids, false if the geometry is unusable
+  bool hashContent();
+  // hashes of the detail last calculated or passed to hashContent
+  uint64 getTopologyHash() const { return TopologyHash; }
+  uint64 getPositionHash() const { return PositionHash; }
+  // control cage edges as strips over the transformed points, a cheap
+  // preview while a new topology gets its limit surface, false when the
+  // cached topology is still current or the geometry is unusable. Builds
+  // the topology index calculateAttributeArrays goes on with
+  bool getCageArrays(UT_Vector3FArray &OutPositions,
+                     UT_Vector3FArray &OutNormals, UT_Array<float> &OutCreases,
+                     UT_Array<int> &OutIndices);
+  // arrays for gl rendering, per sample positions, normals and creases
+  // plus line strip indices separated by StripRestartIndex
   void getAttributeArrays(UT_Vector3FArray &OutPositions,
-                          UT_Vector3FArray &OutColors,
-                          UT_Vector3FArray &OutNormals);
+                          UT_Vector3FArray &OutNormals,
+                          UT_Array<float> &OutCreases,
+                          UT_Array<int> &OutIndices);
+  // true when the detail has a new topology and the cache directory holds
+  // a file for its content at the subdivision level
+  bool hasCacheFile();
+  // stores the uniform limit samples of the last calculateAttributeArrays
+  // in the cache directory, for a batch cook ahead of a session
+  bool writeCacheFile();
   // constructs polyline geo in the target gdp
   void createGeometry(GU_Detail *TargetGdp);
+  // rewrites only P when the target still holds the output of the last
+  // createGeometry and the sample layout is the same, false otherwise
+  bool updateGeometry(GU_Detail *TargetGdp);
+
+  // heap bytes of every array and evaluator table kept between recomputes
+  int64 getMemoryUsage() const;
+
+  // ends a line strip, reads as ~0u when the indices are uploaded unsigned
+  static const int StripRestartIndex = -1;
 
 private:
+  // times the stages one by one
+  friend class IsolineBenchmark;
+
   // Checks if incoming geo only has primitives with n-vertices > 2
   bool isValidGeo();
+  // data ids the topology index is built from
+  struct TopologyIds {
+    GA_DataId Topology = GA_INVALID_DATAID;
+    GA_DataId PrimitiveList = GA_INVALID_DATAID;
+    GA_DataId Crease = GA_INVALID_DATAID;
+    GA_DataId Corner = GA_INVALID_DATAID;
+    GA_DataId Hole = GA_INVALID_DATAID;
+
+    bool isValid() const {
+      return Topology != GA_INVALID_DATAID &&
+             PrimitiveList != GA_INVALID_DATAID;
+    }
+    bool operator==(const TopologyIds &Other) const {
+      return Topology == Other.Topology &&
+             PrimitiveList == Other.PrimitiveList && Crease == Other.Crease &&
+             Corner == Other.Corner && Hole == Other.Hole;
+    }
+  };
+
+  TopologyIds getTopologyIds();
+  // Compares the detail data ids against the ones the cache was built from,
+  // falls back to the topology hash when they differ
+  bool hasTopologyChanged();
+  // key of the current positions, equal for equal content
+  GA_DataId getPositionId();
+  // Rebuilds the topology index, the limit evaluator follows once needed
+  void updateTopology();
+  // uniform layout of the topology with the limit samples of a cache file,
+  // false if there is no file for the content and level
+  bool readCacheFile();
+  // per sample crease weights, corners at -1
+  void getSampleCreases(UT_Array<float> &OutCreases);
   // Adds n = output geometry elements into attribute arrays
   void fillAttributeArrays();
+  // Same with per edge sample counts, also evaluates the limit samples
+  void fillAdaptiveAttributeArrays();
+  void fillCornerSamples();
+  // ptex sample at Factor along the edge, from Points[0] to Points[1]
+  void setEdgeSample(exint EdgeIndex, float Factor, exint Sample);
+  // strips and creases from the per edge sample ranges
+  void fillStripIndices();
+  // Rebuilds the sample table for a new level, keeping the patches and
+  // limit samples the previous level already had
+  void updateSubdivisionLevel();
+  // one open polyline per edge, Cd on points
+  void createEdgeGeometry(GU_Detail *TargetGdp);
+  // edge loops and strips over shared points, Cd on primitives
+  void createChainedGeometry(GU_Detail *TargetGdp);
+  // links every edge end at a regular point to the edge across from it
+  void findEdgeLinks(UT_Array<int> &Links);
+  // copies the sample positions into the output points
+  void writePositions(GU_Detail *TargetGdp);
   // evaluates opensubdiv functions to find the limit surface
   void getLimitSurfacePositions();
+  void getControlPositions(UT_Vector3FArray &ControlPositions);
+  void updatePatchPoints();
   // writes positions into attribute array
   void applyLimitSurfacePositions();
 
+  // first inner sample, inner sample count and first strip index of an edge
+  exint edgeFirstSample(exint Edge) const {
+    return Topology.pointCount() + EdgeSampleOffsets[Edge];
+  }
+  int edgeSampleCount(exint Edge) const {
+    return EdgeSampleOffsets[Edge + 1] - EdgeSampleOffsets[Edge];
+  }
+  exint edgeFirstIndex(exint Edge) const {
+    return EdgeSampleOffsets[Edge] + Edge * 3;
+  }
+
   const GU_Detail *gdp();
-  float getPeakProportional();
+  // peak offsets are relative to the size of the control cage
+  float getBboxScale();
+  bool isCancelled() const;
+
+  GU_ConstDetailHandle GdpHandle;
 
-  GU_DetailHandle GdpHandle;
+  bool UsesTransform = false;
+  UT_DMatrix4 Transform = UT_DMatrix4(1.0);
+  float Peak = 0.0f;
+  int SubdivisionLevel = 1;
+  float Tolerance = 0.0f;
+  bool ChainEdges = false;
+  bool UseStencils = false;
+  UT_StringHolder CacheDirectory;
+  const SYS_AtomicInt32 *CancelFlag = NULL;
 
-  const bool UsesTransform;
-  const UT_DMatrix4 Transform;
-  const float Peak;
-  const int SubdivisionLevel;
+  IsolineTopology Topology;
+  UT_UniquePtr<IsolineLimitEvaluator> Evaluator;
+  // false while the limit samples come from a cache file
+  bool HasEvaluatorTopology = false;
 
-  UT_Vector3FArray Positions, Colors, Normals;
-  UT_Array<int> FaceIndices, ReferenceIndices;
+  // unique samples, one per point then the inner samples of each edge
+  UT_Vector3FArray Positions, Normals;
+  UT_Array<int> FaceIndices;
   UT_Array<float> U, V;
+  // inner samples of edge e start EdgeSampleOffsets[e] after the points
+  UT_Array<exint> EdgeSampleOffsets;
+  // one line strip of sample indices per edge, each followed by
+  // StripRestartIndex, and one crease weight per edge
+  UT_Array<int> StripIndices;
+  UT_Array<float> EdgeCreases;
   bool HasCrease = false;
 
-  GT_DataArrayHandle Surface, LimitNormals;
+  // raw limit surface, peak and transform are applied on top of it
+  UT_Vector3FArray LimitPositions, LimitNormals;
+  // refined and local patch points of the current control positions
+  UT_Vector3FArray PatchPoints;
+  // P the patch points were computed from, stencil evaluation skips them
+  GA_DataId PatchPointsPositionId = GA_INVALID_DATAID;
+  float BboxScale = 0.0f;
+
+  // state the cached topology, samples and limit arrays were built from
+  TopologyIds CachedTopologyIds;
+  uint64 CachedTopologyHash = 0;
+  GA_DataId CachedPositionId = GA_INVALID_DATAID;
+  int CachedSubdivisionLevel = -1;
+  bool CachedAdaptive = false;
+  float CachedTolerance = 0.0f;
+  // bumped whenever the sample table is rebuilt
+  exint LayoutVersion = 0;
+  // layout the limit arrays were last fully evaluated for
+  exint EvaluatedLayoutVersion = -1;
+  // bumped whenever the limit arrays change, and the state the output
+  // arrays were last built from
+  exint LimitVersion = 0;
+  exint AppliedLimitVersion = -1;
+  float AppliedPeak = 0.0f;
+  UT_DMatrix4 AppliedTransform = UT_DMatrix4(1.0);
+  exint ArraysVersion = 0;
+
+  // content keys of the detail being calculated, the position key changes
+  // with the position hash and stands in for the P data id
+  uint64 TopologyHash = 0;
+  TopologyIds HashedTopologyIds;
+  uint64 PositionHash = 0;
+  GA_DataId PositionKey = GA_INVALID_DATAID;
+  GA_DataId HashedPositionDataId = GA_INVALID_DATAID;
+  GA_DataId PositionId = GA_INVALID_DATAID;
+  // ids the primitive scan of isValidGeo last ran for and its outcome
+  TopologyIds ValidatedTopologyIds;
+  bool IsValidTopology = false;
+
+  // sample of every output point and the state createGeometry built from
+  UT_Array<int> OutputSamples;
+  GA_Offset OutputStartOffset = GA_INVALID_OFFSET;
+  exint OutputLayoutVersion = -1;
+  bool OutputChainEdges = false;
+  GA_DataId OutputTopologyId = GA_INVALID_DATAID;
+  GA_DataId OutputPrimitiveListId = GA_INVALID_DATAID;
 };
@@ -0,0 +1,153 @@
+#include "IsolineTopology.h"
+#include "GeometryUtilities.h"
+
+void IsolineTopology::build(const GU_Detail *Gdp) {
+  const GA_Size FaceCount = Gdp->getNumPrimitives();
+  const GA_ROHandleF CreaseHandle(Gdp->findVertexAttribute("creaseweight"));
+  const GA_ROHandleF CornerHandle(Gdp->findPointAttribute("cornerweight"));
+  const GA_ROHandleI HoleHandle(
+      Gdp->findPrimitiveAttribute("subdivision_hole"));
+
+  PointCount = Gdp->getNumPoints();
+  Edges.clear();
+  FaceOffsets.setSizeNoInit(FaceCount + 1);
+  FacePtexOffsets.setSizeNoInit(FaceCount);
+  FacePoints.clear();
+  PointFaces.clear();
+  PointFaces.appendMultiple(-1, PointCount);
+  PointSlots.clear();
+  PointSlots.appendMultiple(0, PointCount);
+  CornerPoints.clear();
+  CornerWeights.clear();
+  HoleFaces.clear();
+  HasCrease = false;
+
+  for (GA_Index Point = 0; CornerHandle.isValid() && Point < PointCount;
+       ++Point) {
+    const float Weight = CornerHandle(Gdp->pointOffset(Point));
+    if (Weight <= 0.0f)
+      continue;
+    CornerPoints.append(Point);
+    CornerWeights.append(Weight);
+  }
+
+  // flatten vertex lists, every corner also names the half-edge to the next
+  // corner of the same face
+  UT_Array<int> CornerFaces;
+  UT_Array<float> EdgeWeights;
+  UT_Array<bool> IsHole;
+  IsHole.setSizeNoInit(FaceCount);
+  FaceOffsets[0] = 0;
+  int PtexCount = 0;
+  for (GA_Index Face = 0; Face < FaceCount; ++Face) {
+    const GA_Offset FaceOffset = Gdp->primitiveOffset(Face);
+    IsHole[Face] = HoleHandle.isValid() && HoleHandle(FaceOffset) != 0;
+    if (IsHole[Face])
+      HoleFaces.append(Face);
+
+    const GA_OffsetListRef Vertices = Gdp->getPrimitiveVertexList(FaceOffset);
+    for (GA_Size x = 0; x < Vertices.entries(); ++x) {
+      const GA_Offset VertexOffset = Vertices.get(x);
+      const int Point = Gdp->pointIndex(Gdp->vertexPoint(VertexOffset));
+      if (PointFaces[Point] < 0 ||
+          (IsHole[PointFaces[Point]] && !IsHole[Face])) {
+        PointFaces[Point] = Face;
+        PointSlots[Point] = x;
+      }
+      FacePoints.append(Point);
+      CornerFaces.append(Face);
+      EdgeWeights.append(CreaseHandle.isValid() ? CreaseHandle(VertexOffset)
+                                                : 0.0f);
+    }
+    FaceOffsets[Face + 1] = FacePoints.entries();
+    FacePtexOffsets[Face] = PtexCount;
+    PtexCount += Vertices.entries() == 4 ? 1 : Vertices.entries();
+  }
+
+  auto nextCorner = [&](int Corner) {
+    const int Face = CornerFaces[Corner];
+    return Corner + 1 < FaceOffsets[Face + 1] ? Corner + 1 : FaceOffsets[Face];
+  };
+
+  // bucket half-edges by their higher point index
+  UT_Array<int> BucketOffsets;
+  BucketOffsets.appendMultiple(0, PointCount + 1);
+  for (int Corner = 0; Corner < FacePoints.entries(); ++Corner) {
+    int High = SYSmax(FacePoints[Corner], FacePoints[nextCorner(Corner)]);
+    BucketOffsets[High + 1]++;
+  }
+  for (int x = 0; x < PointCount; ++x)
+    BucketOffsets[x + 1] += BucketOffsets[x];
+
+  UT_Array<int> Buckets, Cursors(BucketOffsets);
+  Buckets.setSizeNoInit(FacePoints.entries());
+  for (int Corner = 0; Corner < FacePoints.entries(); ++Corner) {
+    int High = SYSmax(FacePoints[Corner], FacePoints[nextCorner(Corner)]);
+    Buckets[Cursors[High]++] = Corner;
+  }
+
+  // merge half-edges into edges, a bucket only holds the point's valence
+  // worth of entries so the lookup stays local
+  Edges.setCapacity(FacePoints.entries() / 2 + 1);
+  float OverallCreaseValue = 0.0f;
+  for (int Point = 0; Point < PointCount; ++Point) {
+    const exint FirstEdge = Edges.entries();
+
+    for (int x = BucketOffsets[Point]; x < BucketOffsets[Point + 1]; ++x) {
+      const int Corner = Buckets[x];
+      const int Next = nextCorner(Corner);
+      const int Face = CornerFaces[Corner];
+      const int Low = SYSmin(FacePoints[Corner], FacePoints[Next]);
+      if (Low == Point)
+        continue;
+
+      exint EdgeIndex = FirstEdge;
+      while (EdgeIndex < Edges.entries() && Edges[EdgeIndex].Points[0] != Low)
+        EdgeIndex++;
+
+      const int CornerSlot = Corner - FaceOffsets[Face];
+      const int NextSlot = Next - FaceOffsets[Face];
+      const bool Forward = FacePoints[Corner] == Low;
+
+      if (EdgeIndex == Edges.entries()) {
+        Edge NewEdge;
+        NewEdge.Points[0] = Low;
+        NewEdge.Points[1] = Point;
+        NewEdge.Faces[0] = Face;
+        NewEdge.Faces[1] = -1;
+        NewEdge.Slots[0] = Forward ? CornerSlot : NextSlot;
+        NewEdge.Slots[1] = Forward ? NextSlot : CornerSlot;
+        // holds the first face weight until the second face is found
+        NewEdge.Crease = EdgeWeights[Corner];
+        Edges.append(NewEdge);
+      } else if (Edges[EdgeIndex].Faces[1] < 0) {
+        Edge &SharedEdge = Edges[EdgeIndex];
+        SharedEdge.Faces[1] = Face;
+        // samples are taken in Faces[0], which has to have a surface
+        if (IsHole[SharedEdge.Faces[0]] && !IsHole[Face]) {
+          SharedEdge.Faces[1] = SharedEdge.Faces[0];
+          SharedEdge.Faces[0] = Face;
+          SharedEdge.Slots[0] = Forward ? CornerSlot : NextSlot;
+          SharedEdge.Slots[1] = Forward ? NextSlot : CornerSlot;
+        }
+        if (!GeometryUtilities::almostEqual(SharedEdge.Crease,
+                                            EdgeWeights[Corner]))
+          SharedEdge.Crease = 0.0f;
+        OverallCreaseValue += SharedEdge.Crease;
+      }
+    }
+  }
+
+  // boundary edges are never creased, edges inside holes are dropped
+  exint KeptCount = 0;
+  for (exint x = 0; x < Edges.entries(); ++x) {
+    if (IsHole[Edges[x].Faces[0]])
+      continue;
+    if (Edges[x].Faces[1] < 0)
+      Edges[x].Crease = 0.0f;
+    Edges[KeptCount++] = Edges[x];
+  }
+  Edges.setSize(KeptCount);
+
+  HasCrease = CreaseHandle.isValid() && OverallCreaseValue >= 0.01f;
+}
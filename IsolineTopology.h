@@ -0,0 +1,73 @@
+#pragma once
+
+#include <GU/GU_Detail.h>
+#include <UT/UT_Array.h>
+
+// Flat edge index of a polygon mesh, built in a single pass over the
+// primitives. Replaces per-edge adjacency queries on the detail.
+class IsolineTopology {
+public:
+  struct Edge {
+    // point indices, Points[0] < Points[1]
+    int Points[2];
+    // indices of the first two adjacent primitives, -1 on a boundary,
+    // Faces[0] is never a hole when the edge borders a surface face
+    int Faces[2];
+    // local vertex numbers of Points[0] and Points[1] in Faces[0]
+    int Slots[2];
+    // crease weight if both faces agree on it, 0 otherwise
+    float Crease;
+  };
+
+  // edges that only border holes are left out, nothing is drawn there
+  void build(const GU_Detail *Gdp);
+
+  exint edgeCount() const { return Edges.entries(); }
+  const Edge &edge(exint Index) const { return Edges[Index]; }
+
+  int pointCount() const { return PointCount; }
+  int faceCount() const { return FaceOffsets.entries() - 1; }
+  int faceSize(int Face) const {
+    return FaceOffsets[Face + 1] - FaceOffsets[Face];
+  }
+  // point index of the given local vertex of the face
+  int facePoint(int Face, int Slot) const {
+    return FacePoints[FaceOffsets[Face] + Slot];
+  }
+  // vertex lists of all faces concatenated
+  const UT_Array<int> &facePoints() const { return FacePoints; }
+  // a face using the point and the point's local vertex number in it,
+  // preferably not a hole, the face is -1 for points without primitives
+  int pointFace(int Point) const { return PointFaces[Point]; }
+  int pointSlot(int Point) const { return PointSlots[Point]; }
+  // first ptex face of the face, non-quads are split into one per corner
+  int facePtexIndex(int Face) const { return FacePtexOffsets[Face]; }
+
+  bool hasCrease() const { return HasCrease; }
+  // points with a cornerweight above 0 and their weights
+  const UT_Array<int> &cornerPoints() const { return CornerPoints; }
+  const UT_Array<float> &cornerWeights() const { return CornerWeights; }
+  // faces with subdivision_hole set, they have no limit surface
+  const UT_Array<int> &holeFaces() const { return HoleFaces; }
+
+  int64 getMemoryUsage() const {
+    return Edges.getMemoryUsage() + FaceOffsets.getMemoryUsage() +
+           FacePoints.getMemoryUsage() + FacePtexOffsets.getMemoryUsage() +
+           PointFaces.getMemoryUsage() + PointSlots.getMemoryUsage() +
+           CornerPoints.getMemoryUsage() + CornerWeights.getMemoryUsage() +
+           HoleFaces.getMemoryUsage();
+  }
+
+private:
+  UT_Array<Edge> Edges;
+  // per face vertex lists as point indices, FaceOffsets has faceCount() + 1
+  // entries
+  UT_Array<int> FaceOffsets, FacePoints;
+  UT_Array<int> FacePtexOffsets;
+  UT_Array<int> PointFaces, PointSlots;
+  UT_Array<int> CornerPoints;
+  UT_Array<float> CornerWeights;
+  UT_Array<int> HoleFaces;
+  int PointCount = 0;
+  bool HasCrease = false;
+};
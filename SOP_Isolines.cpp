@@ -1,7 +1,6 @@
 
 #include "SOP_Isolines.h"
 
-#include <OP/OP_AutoLockInputs.h>
 #include <OP/OP_Operator.h>
 #include <OP/OP_OperatorTable.h>
 #include <PRM/PRM_Include.h>
@@ -14,8 +13,11 @@
 
 #include "GeometryUtilities.h"
 #include "IsolineMaker.h"
+#include "SOP_Isolines.proto.h"
 
-const char *DsFile = R"THEDSFILE(
+const UT_StringHolder SOP_Isolines::theSOPTypeName("cb_isolines");
+
+static const char *theDsFile = R"THEDSFILE(
 {
   name parameters
   parm {
@@ -32,17 +34,58 @@ const char *DsFile = R"THEDSFILE(
     default { "0.005" }
     range { "0.0001"! "0.1" }
   }
+  parm {
+    name "adaptive"
+    label "Adaptive"
+    type toggle
+    default { "0" }
+  }
+  parm {
+    name "tolerance"
+    label "Chord Tolerance"
+    type float
+    default { "0.001" }
+    range { "0.00001"! "0.01" }
+    disablewhen "{ adaptive == 0 }"
+  }
+  parm {
+    name "chainedges"
+    label "Chain Edge Loops"
+    type toggle
+    default { "0" }
+  }
+  parm {
+    name "usestencils"
+    label "Limit Stencils"
+    type toggle
+    default { "0" }
+    disablewhen "{ adaptive == 1 }"
+  }
+  parm {
+    name "cachedir"
+    label "Cache Directory"
+    type directory
+    default { "" }
+  }
+  parm {
+    name "writecache"
+    label "Write Cache Files"
+    type toggle
+    default { "0" }
+    disablewhen "{ cachedir == \"\" } { adaptive == 1 }"
+  }
 }
 )THEDSFILE";
 
-PRM_Template *getTemplate() {
-  return PRM_TemplateBuilder("SOP_Isolines.C", DsFile).templates();
+PRM_Template *SOP_Isolines::buildTemplates() {
+  static PRM_TemplateBuilder Templates("SOP_Isolines.cpp", theDsFile);
+  return Templates.templates();
 }
 
 void newSopOperator(OP_OperatorTable *table) {
-  table->addOperator(new OP_Operator("cb_isolines", "Isolines",
-                                     SOP_Isolines::myConstructor, getTemplate(),
-                                     1, 1));
+  table->addOperator(new OP_Operator(
+      SOP_Isolines::theSOPTypeName, "Isolines", SOP_Isolines::myConstructor,
+      SOP_Isolines::buildTemplates(), 1, 1));
 }
 
 OP_Node *SOP_Isolines::myConstructor(OP_Network *net, const char *name,
@@ -60,28 +103,63 @@ SOP_Isolines::~SOP_Isolines() {}
 
 OP_ERROR
 SOP_Isolines::cookMySop(OP_Context &Context) {
+  return cookMyselfAsVerb(Context);
+}
+
+// Stateless cook, everything kept between cooks lives in the node cache,
+// so compiled blocks can run any number of pieces at once
+class SOP_IsolinesVerb : public SOP_NodeVerb {
+public:
+  virtual SOP_NodeParms *allocParms() const { return new SOP_IsolinesParms(); }
+  virtual SOP_NodeCache *allocCache() const { return new SOP_IsolinesCache(); }
+  virtual UT_StringHolder name() const { return SOP_Isolines::theSOPTypeName; }
 
-  OP_AutoLockInputs inputs(this);
+  virtual CookMode cookMode(const SOP_NodeParms *Parms) const {
+    return COOK_GENERIC;
+  }
+
+  virtual void cook(const CookParms &CookParms) const;
 
-  if (inputs.lock(Context) >= UT_ERROR_ABORT)
-    return error();
+  static const SOP_NodeVerb::Register<SOP_IsolinesVerb> theVerb;
+};
 
-  GU_Detail *TargetGdp = gdp;
+const SOP_NodeVerb::Register<SOP_IsolinesVerb> SOP_IsolinesVerb::theVerb;
 
-  if (error() < UT_ERROR_ABORT) {
-    UT_AutoInterrupt Progress("Drawing Isolines");
-    GU_DetailHandle InputGdpHandle = inputGeoHandle(0);
+const SOP_NodeVerb *SOP_Isolines::cookVerb() const {
+  return SOP_IsolinesVerb::theVerb.get();
+}
+
+void SOP_IsolinesVerb::cook(const CookParms &CookParms) const {
+  const SOP_IsolinesParms &Parms = CookParms.parms<SOP_IsolinesParms>();
+  SOP_IsolinesCache *Cache = (SOP_IsolinesCache *)CookParms.cache();
+  IsolineMaker &IsoMaker = Cache->IsoMaker;
+  GU_Detail *TargetGdp = CookParms.gdh().gdpNC();
+
+  UT_AutoInterrupt Progress("Drawing Isolines");
+
+  IsoMaker.setDetail(CookParms.inputGeoHandle(0));
+  IsoMaker.setPeak(Parms.getPeak());
+  IsoMaker.setSubdivisionLevel(Parms.getSubdlevel());
+  IsoMaker.setTolerance(Parms.getAdaptive() ? Parms.getTolerance() : 0.0f);
+  IsoMaker.setChainEdges(Parms.getChainedges());
+  IsoMaker.setUseStencils(Parms.getUsestencils());
+  IsoMaker.setCacheDirectory(Parms.getCachedir());
+
+  if (!IsoMaker.calculateAttributeArrays()) {
+    IsoMaker.setDetail(GU_ConstDetailHandle());
+    return;
+  }
 
-    fpreal Now = Context.getTime();
-    IsolineMaker IsoMaker(InputGdpHandle, evalFloat("peak", 0, Now),
-                          evalInt("subdlevel", 0, Now));
+  // batch cooks fill the cache directory for later sessions
+  if (Parms.getWritecache() && !IsoMaker.writeCacheFile())
+    CookParms.sopAddWarning(SOP_MESSAGE, "Could not write the cache file");
 
-    if (IsoMaker.calculateAttributeArrays()) {
-      TargetGdp->clearAndDestroy();
-      IsoMaker.createGeometry(TargetGdp);
-    }
+  // a deforming input keeps the output topology and only moves P
+  if (!IsoMaker.updateGeometry(TargetGdp)) {
+    TargetGdp->clearAndDestroy();
+    IsoMaker.createGeometry(TargetGdp);
   }
 
-  resetLocalVarRefs();
-  return error();
+  // the input is only read, don't keep it alive with the cache
+  IsoMaker.setDetail(GU_ConstDetailHandle());
 }
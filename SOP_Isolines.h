@@ -1,12 +1,27 @@
+#include "IsolineMaker.h"
+
 #include <GT/GT_DataArray.h>
 #include <SOP/SOP_Node.h>
+#include <SOP/SOP_NodeVerb.h>
 
 class SOP_Isolines : public SOP_Node {
 public:
+  static PRM_Template *buildTemplates();
   static OP_Node *myConstructor(OP_Network *, const char *, OP_Operator *);
 
+  static const UT_StringHolder theSOPTypeName;
+
+  virtual const SOP_NodeVerb *cookVerb() const;
+
 protected:
   SOP_Isolines(OP_Network *net, const char *name, OP_Operator *op);
   virtual ~SOP_Isolines();
   virtual OP_ERROR cookMySop(OP_Context &Context);
 };
+
+// Per node state of the verb, keeps the limit evaluator between cooks so a
+// deforming input doesn't rebuild the patches
+class SOP_IsolinesCache : public SOP_NodeCache {
+public:
+  IsolineMaker IsoMaker;
+};